@@ -0,0 +1,370 @@
+#include "./synthetic.hpp"
+
+#include <causenet/causenet.hpp>
+#include <utils/generator.hpp>
+#include <utils/landmarks.hpp>
+#include <utils/reorder.hpp>
+#include <utils/shortest_paths.hpp>
+
+#include <benchmark/benchmark.h>
+
+#include <cstdlib>
+#include <cstring>
+#include <iostream>
+#include <memory>
+#include <string>
+#include <vector>
+
+using causenet::Causenet;
+
+/**
+ * Benchmarks of the hot paths of the causenet library on a synthetic graph (see bench::SyntheticConfig), e.g.:
+ * `causenet_bench --nodes=1000000 --benchmark_filter=PathSearch`
+ * The graph is generated into `--dir` (default: the system's temporary directory) on first use and reused afterwards.
+ * `--causenet=<path>` runs the benchmarks on an existing file such as the real CauseNet instead, e.g. to compare the
+ * traversals under each utils::NodeOrdering with `--benchmark_filter=Reordered`. All other flags are passed on to
+ * Google Benchmark.
+ */
+namespace {
+	bench::SyntheticConfig config;
+	std::filesystem::path dataDir = std::filesystem::temp_directory_path() / "causenet_bench";
+
+	constexpr size_t numQueries = 4096;
+
+	/** If set, the benchmarks run on this file (e.g., the real CauseNet) instead of the synthetic graph **/
+	std::filesystem::path causenetPath;
+
+	const std::filesystem::path& causenetFile() {
+		static const auto path = causenetPath.empty() ? bench::synthetic(config, dataDir) : causenetPath;
+		return path;
+	}
+
+	const Causenet& causenet() {
+		static const auto causenet = Causenet::fromFile(causenetFile());
+		return causenet;
+	}
+
+	/**
+	 * The synthetic graph with `compressed` sources (see bench::SyntheticConfig::compress), which holds the same
+	 * supports as causenet(); nullptr if the benchmarks run on a given file
+	 */
+	const Causenet* supportsCausenet(bool compressed) {
+		if (!compressed)
+			return &causenet();
+		static const auto causenet = [] {
+			auto compressedConfig = config;
+			compressedConfig.compress = true;
+			return causenetPath.empty()
+						   ? std::make_unique<Causenet>(Causenet::fromFile(bench::synthetic(compressedConfig, dataDir)))
+						   : nullptr;
+		}();
+		return causenet.get();
+	}
+
+	/** Nodes that have at least one effect, drawn uniformly such that popular and rare concepts are mixed **/
+	const std::vector<size_t>& queryNodes() {
+		static const auto nodes = [] {
+			bench::Random random(config.seed + 1);
+			std::vector<size_t> nodes;
+			while (nodes.size() < numQueries) {
+				auto idx = random.below(causenet().numConcepts());
+				if (causenet().numEffects(idx) > 0)
+					nodes.push_back(idx);
+			}
+			return nodes;
+		}();
+		return nodes;
+	}
+
+	void BM_GetConceptIdx(benchmark::State& state) {
+		std::vector<std::string> names;
+		for (auto idx : queryNodes())
+			names.push_back(causenet().getConceptByIdx(idx));
+		size_t i = 0;
+		for (auto _ : state)
+			benchmark::DoNotOptimize(causenet().getConceptIdx(names[i++ % names.size()]));
+		state.SetItemsProcessed(state.iterations());
+	}
+	BENCHMARK(BM_GetConceptIdx);
+
+	void BM_GetConceptIdxMiss(benchmark::State& state) {
+		std::vector<std::string> names;
+		for (auto idx : queryNodes())
+			names.push_back(causenet().getConceptByIdx(idx) + " missing");
+		size_t i = 0;
+		for (auto _ : state)
+			benchmark::DoNotOptimize(causenet().getConceptIdx(names[i++ % names.size()]));
+		state.SetItemsProcessed(state.iterations());
+	}
+	BENCHMARK(BM_GetConceptIdxMiss);
+
+	void BM_GetEffects(benchmark::State& state) {
+		size_t i = 0, edges = 0;
+		for (auto _ : state) {
+			for (auto&& [effect, support] : causenet().getEffects(queryNodes()[i++ % numQueries])) {
+				benchmark::DoNotOptimize(effect);
+				++edges;
+			}
+		}
+		state.SetItemsProcessed(edges);
+	}
+	BENCHMARK(BM_GetEffects);
+
+	/** Baseline for BM_GetEffects that reads the same adjacency without the EdgeRange **/
+	void BM_EffectGraphRow(benchmark::State& state) {
+		const auto graph = causenet().effectGraph();
+		size_t i = 0, edges = 0;
+		for (auto _ : state) {
+			const auto node = queryNodes()[i++ % numQueries];
+			for (auto e = graph.rows[node]; e < graph.rows[node + 1]; ++e) {
+				benchmark::DoNotOptimize(graph.adj[e]);
+				benchmark::DoNotOptimize(causenet().numSupport(e));
+				++edges;
+			}
+		}
+		state.SetItemsProcessed(edges);
+	}
+	BENCHMARK(BM_EffectGraphRow);
+
+	Generator<size_t> sequence(size_t n) {
+		for (size_t i = 0; i < n; ++i)
+			co_yield i;
+	}
+	/** Cost of creating a Generator and resuming it `range(0)` times **/
+	void BM_Generator(benchmark::State& state) {
+		const auto n = static_cast<size_t>(state.range(0));
+		for (auto _ : state)
+			for (auto i : sequence(n))
+				benchmark::DoNotOptimize(i);
+		state.SetItemsProcessed(state.iterations() * n);
+	}
+	BENCHMARK(BM_Generator)->Arg(1)->Arg(16)->Arg(1024);
+
+	/** Decodes every support of an edge without copying it; from compressed sources if state.range(0) is 1 **/
+	void BM_SupportViews(benchmark::State& state) {
+		const auto* causenet = supportsCausenet(state.range(0) != 0);
+		if (causenet == nullptr)
+			return state.SkipWithError("Compressed sources need the synthetic graph");
+		state.SetLabel(state.range(0) != 0 ? "compressed" : "uncompressed");
+		const auto graph = causenet->effectGraph();
+		size_t i = 0, supports = 0;
+		for (auto _ : state) {
+			const auto node = queryNodes()[i++ % numQueries];
+			for (auto view : causenet->getSupportViews(node, graph.adj[graph.rows[node]])) {
+				benchmark::DoNotOptimize(view.content.size());
+				++supports;
+			}
+		}
+		state.SetItemsProcessed(supports);
+	}
+	BENCHMARK(BM_SupportViews)->Arg(0)->Arg(1);
+
+	void BM_GetSupport(benchmark::State& state) {
+		const auto* causenet = supportsCausenet(state.range(0) != 0);
+		if (causenet == nullptr)
+			return state.SkipWithError("Compressed sources need the synthetic graph");
+		state.SetLabel(state.range(0) != 0 ? "compressed" : "uncompressed");
+		const auto graph = causenet->effectGraph();
+		size_t i = 0, supports = 0;
+		for (auto _ : state) {
+			const auto node = queryNodes()[i++ % numQueries];
+			auto copies = causenet->getSupport(node, graph.adj[graph.rows[node]]);
+			supports += copies.size();
+			benchmark::DoNotOptimize(copies.data());
+		}
+		state.SetItemsProcessed(supports);
+	}
+	BENCHMARK(BM_GetSupport)->Arg(0)->Arg(1);
+
+	/** utils::shortestPath() driven by the EdgeRange of getEffects() **/
+	void BM_ShortestPath(benchmark::State& state) {
+		auto neighbors = [](size_t idx) { return causenet().getEffects(idx); };
+		size_t i = 0;
+		for (auto _ : state) {
+			const auto start = queryNodes()[i % numQueries], target = queryNodes()[(i + 1) % numQueries];
+			++i;
+			benchmark::DoNotOptimize(utils::shortestPath(start, target, neighbors));
+		}
+	}
+	BENCHMARK(BM_ShortestPath)->Unit(benchmark::kMillisecond);
+
+	/** The precomputed lengths under the causenet::EdgeWeighting state.range(0) as the REST API reads them **/
+	auto weightFn(const benchmark::State& state) {
+		const auto weighting = static_cast<causenet::EdgeWeighting>(state.range(0));
+		return [weights = causenet().edgeWeights(weighting)](std::uint64_t edge) -> std::uint64_t {
+			return weights.empty() ? 1 : weights[edge];
+		};
+	}
+
+	/** The bidirectional search over the CSR sections as used by the REST API **/
+	void BM_PathSearch(benchmark::State& state) {
+		auto& search = utils::PathSearch<std::uint64_t>::threadLocal();
+		auto weight = weightFn(state);
+		state.SetLabel(std::string(causenet::edgeWeightingName(static_cast<causenet::EdgeWeighting>(state.range(0)))));
+		const auto forward = causenet().effectGraph(), backward = causenet().causeGraph();
+		size_t i = 0;
+		for (auto _ : state) {
+			const auto start = queryNodes()[i % numQueries], target = queryNodes()[(i + 1) % numQueries];
+			++i;
+			benchmark::DoNotOptimize(search.shortestPath(forward, backward, start, target, weight));
+		}
+	}
+	BENCHMARK(BM_PathSearch)->DenseRange(0, causenet::numEdgeWeightings - 1)->Unit(benchmark::kMicrosecond);
+
+	/** A* guided by state.range(1) farthest-first landmarks, which are computed before timing **/
+	void BM_PathSearchLandmarks(benchmark::State& state) {
+		auto& search = utils::PathSearch<std::uint64_t>::threadLocal();
+		auto weight = weightFn(state);
+		const auto forward = causenet().effectGraph(), backward = causenet().causeGraph();
+		const auto landmarks = utils::selectLandmarks(
+				forward, backward, state.range(1), utils::LandmarkSelection::Farthest, weight
+		);
+		const utils::LandmarkBounds bounds{
+				.numLandmarks = landmarks.nodes.size(), .from = landmarks.from, .to = landmarks.to
+		};
+		size_t i = 0, expanded = 0;
+		for (auto _ : state) {
+			const auto start = queryNodes()[i % numQueries], target = queryNodes()[(i + 1) % numQueries];
+			++i;
+			utils::PathSearchStats stats;
+			auto bound = [&](std::uint32_t node) { return bounds.lowerBound(node, target); };
+			benchmark::DoNotOptimize(
+					search.shortestPathAStar(forward, start, target, weight, bound, utils::PathSearchLimits{}, stats)
+			);
+			expanded += stats.expandedNodes;
+		}
+		state.counters["expanded"] = benchmark::Counter((double)expanded, benchmark::Counter::kAvgIterations);
+	}
+	BENCHMARK(BM_PathSearchLandmarks)
+			->Args({static_cast<int>(causenet::EdgeWeighting::InverseSupport), 8})
+			->Args({static_cast<int>(causenet::EdgeWeighting::InverseSupport), 16})
+			->Unit(benchmark::kMicrosecond);
+
+	/** causenet() with its concepts renumbered by `ordering`; the file is written into `--dir` on first use **/
+	const Causenet& reordered(utils::NodeOrdering ordering) {
+		static std::unique_ptr<Causenet> causenets[utils::numNodeOrderings];
+		if (ordering == utils::NodeOrdering::Input)
+			return causenet();
+		auto& reordered = causenets[static_cast<size_t>(ordering)];
+		if (!reordered) {
+			const auto path = dataDir / (causenetFile().stem().string() + "-" +
+										 std::string(utils::nodeOrderingName(ordering)) + ".causenet");
+			if (!std::filesystem::exists(path)) {
+				std::filesystem::create_directories(dataDir);
+				Causenet::reorder(causenetFile(), path, ordering);
+			}
+			reordered = std::make_unique<Causenet>(Causenet::fromFile(path));
+		}
+		return *reordered;
+	}
+
+	/** The queryNodes() as numbered by reordered(`ordering`) such that every ordering runs the same traversals **/
+	std::vector<std::uint32_t> reorderedQueries(utils::NodeOrdering ordering) {
+		std::vector<std::uint32_t> queries;
+		for (auto idx : queryNodes())
+			queries.push_back(reordered(ordering).getConceptIdx(causenet().getConceptName(idx)));
+		return queries;
+	}
+
+	/** Breadth-first search over all effects reachable from a query node of the utils::NodeOrdering state.range(0) **/
+	void BM_ReorderedBFS(benchmark::State& state) {
+		const auto ordering = static_cast<utils::NodeOrdering>(state.range(0));
+		state.SetLabel(std::string(utils::nodeOrderingName(ordering)));
+		const auto graph = reordered(ordering).effectGraph();
+		const auto queries = reorderedQueries(ordering);
+		std::vector<std::uint32_t> visited(graph.numNodes(), 0), queue;
+		std::uint32_t generation = 0;
+		size_t i = 0, reached = 0;
+		for (auto _ : state) {
+			++generation;
+			queue.assign(1, queries[i++ % numQueries]);
+			visited[queue[0]] = generation;
+			for (size_t head = 0; head < queue.size(); ++head) {
+				const auto node = queue[head];
+				for (auto e = graph.rows[node]; e < graph.rows[node + 1]; ++e) {
+					if (visited[graph.adj[e]] != generation) {
+						visited[graph.adj[e]] = generation;
+						queue.push_back(graph.adj[e]);
+					}
+				}
+			}
+			reached += queue.size();
+		}
+		state.SetItemsProcessed(reached);
+	}
+	BENCHMARK(BM_ReorderedBFS)->DenseRange(0, utils::numNodeOrderings - 1)->Unit(benchmark::kMillisecond);
+
+	/** BM_PathSearch weighted by inverse support on the utils::NodeOrdering state.range(0) **/
+	void BM_ReorderedPathSearch(benchmark::State& state) {
+		auto& search = utils::PathSearch<std::uint64_t>::threadLocal();
+		const auto ordering = static_cast<utils::NodeOrdering>(state.range(0));
+		state.SetLabel(std::string(utils::nodeOrderingName(ordering)));
+		const auto forward = reordered(ordering).effectGraph(), backward = reordered(ordering).causeGraph();
+		const auto weights = reordered(ordering).edgeWeights(causenet::EdgeWeighting::InverseSupport);
+		auto weight = [weights](std::uint64_t edge) -> std::uint64_t { return weights[edge]; };
+		const auto queries = reorderedQueries(ordering);
+		size_t i = 0;
+		for (auto _ : state) {
+			const auto start = queries[i % numQueries], target = queries[(i + 1) % numQueries];
+			++i;
+			benchmark::DoNotOptimize(search.shortestPath(forward, backward, start, target, weight));
+		}
+	}
+	BENCHMARK(BM_ReorderedPathSearch)->DenseRange(0, utils::numNodeOrderings - 1)->Unit(benchmark::kMicrosecond);
+
+	/** Consumes the flags that configure the synthetic graph and leaves the others for Google Benchmark **/
+	bool parseFlags(int& argc, char* argv[]) {
+		int kept = 1;
+		for (int i = 1; i < argc; ++i) {
+			std::string arg = argv[i];
+			auto value = [&](const char* name) -> const char* {
+				const auto len = std::strlen(name);
+				return (arg.compare(0, len, name) == 0 && arg[len] == '=') ? argv[i] + len + 1 : nullptr;
+			};
+			if (auto v = value("--nodes"))
+				config.numNodes = std::strtoull(v, nullptr, 10);
+			else if (auto v = value("--min-degree"))
+				config.minDegree = std::strtoul(v, nullptr, 10);
+			else if (auto v = value("--max-degree"))
+				config.maxDegree = std::strtoul(v, nullptr, 10);
+			else if (auto v = value("--degree-exponent"))
+				config.degreeExponent = std::strtod(v, nullptr);
+			else if (auto v = value("--target-skew"))
+				config.targetSkew = std::strtod(v, nullptr);
+			else if (auto v = value("--max-support"))
+				config.maxSupport = std::strtoul(v, nullptr, 10);
+			else if (auto v = value("--support-exponent"))
+				config.supportExponent = std::strtod(v, nullptr);
+			else if (auto v = value("--sentence-words"))
+				config.sentenceWords = std::strtoul(v, nullptr, 10);
+			else if (auto v = value("--seed"))
+				config.seed = std::strtoull(v, nullptr, 10);
+			else if (auto v = value("--dir"))
+				dataDir = v;
+			else if (auto v = value("--causenet"))
+				causenetPath = v;
+			else
+				argv[kept++] = argv[i];
+		}
+		argc = kept;
+		return config.numNodes >= 2 && config.minDegree >= 1 && config.minDegree <= config.maxDegree &&
+			   config.degreeExponent > 1 && config.supportExponent > 1 && config.maxSupport >= 1;
+	}
+} // namespace
+
+int main(int argc, char* argv[]) {
+	if (!parseFlags(argc, argv)) {
+		std::cerr << "Usage: " << argv[0]
+				  << " [--nodes=<n>] [--min-degree=<n>] [--max-degree=<n>] [--degree-exponent=<x>] [--target-skew=<x>]"
+					 " [--max-support=<n>] [--support-exponent=<x>] [--sentence-words=<n>] [--seed=<n>] [--dir=<path>]"
+					 " [--causenet=<path>] [benchmark flags]"
+				  << std::endl;
+		return 1;
+	}
+	benchmark::Initialize(&argc, argv);
+	if (benchmark::ReportUnrecognizedArguments(argc, argv))
+		return 1;
+	benchmark::RunSpecifiedBenchmarks();
+	benchmark::Shutdown();
+	return 0;
+}
@@ -0,0 +1,540 @@
+#include "./synthetic.hpp"
+
+#include <causenet/causenet.hpp>
+#include <warc_index.hpp>
+
+#include <rapidjson/document.h>
+
+#include <algorithm>
+#include <atomic>
+#include <cctype>
+#include <chrono>
+#include <csignal>
+#include <cstdio>
+#include <fstream>
+#include <iostream>
+#include <map>
+#include <string>
+#include <string_view>
+#include <thread>
+#include <vector>
+
+#include <arpa/inet.h>
+#include <fcntl.h>
+#include <netdb.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <sys/socket.h>
+#include <sys/wait.h>
+#include <unistd.h>
+
+using causenet::Causenet;
+namespace fs = std::filesystem;
+using Clock = std::chrono::steady_clock;
+
+/**
+ * Load test of causenetexe that replays a JSONL trace of requests and reports the throughput and latency percentiles
+ * per route, e.g.:
+ * `causenet_loadtest --server build/src/causenetexe --nodes 200000 --concurrency 64 --repeat 5`
+ * Unless `--url` points to a running server, the server is started within `--workdir` on a synthetic graph (see
+ * bench::SyntheticConfig) with a fake ClueWeb12 directory standing in for the real corpus. Every line of the trace is
+ * an object like `{"path": "/v1/nodes/death/effects", "route": "effects"}`; `route` groups the requests within the
+ * report and defaults to the path with the concept names and page ids replaced by placeholders. Without `--trace`, a
+ * trace is generated from the synthetic graph.
+ */
+namespace {
+	struct Options {
+		fs::path server;
+		std::string host = "127.0.0.1";
+		std::uint16_t port = 18432;
+		bool external = false; ///< Whether to test the server at `--url` instead of starting one
+		fs::path workdir = fs::temp_directory_path() / "causenet_loadtest";
+		fs::path trace;
+		size_t traceLength = 20000;
+		unsigned concurrency = 16;
+		size_t repeat = 1;
+		size_t warmup = 0;
+		bool cache = true;
+		bool clueWebIndex = true; ///< Whether the server finds the ClueWeb12 records by index instead of by scanning
+		bench::SyntheticConfig graph;
+	};
+
+	/** @brief Blocking HTTP/1.1 client that keeps its connection alive between requests **/
+	class Connection final {
+	private:
+		const Options& options;
+		int fd = -1;
+		std::string buffer;
+
+		bool connect() {
+			addrinfo hints{};
+			hints.ai_family = AF_UNSPEC;
+			hints.ai_socktype = SOCK_STREAM;
+			addrinfo* addresses;
+			if (::getaddrinfo(options.host.c_str(), std::to_string(options.port).c_str(), &hints, &addresses) != 0)
+				return false;
+			for (auto addr = addresses; addr != nullptr && fd < 0; addr = addr->ai_next) {
+				fd = ::socket(addr->ai_family, addr->ai_socktype, addr->ai_protocol);
+				if (fd >= 0 && ::connect(fd, addr->ai_addr, addr->ai_addrlen) != 0)
+					close();
+			}
+			::freeaddrinfo(addresses);
+			if (fd < 0)
+				return false;
+			int one = 1;
+			::setsockopt(fd, IPPROTO_TCP, TCP_NODELAY, &one, sizeof(one));
+			return true;
+		}
+
+		void close() {
+			if (fd >= 0)
+				::close(fd);
+			fd = -1;
+			buffer.clear();
+		}
+
+		bool readMore() {
+			char chunk[1 << 16];
+			auto n = ::recv(fd, chunk, sizeof(chunk), 0);
+			if (n <= 0)
+				return false;
+			buffer.append(chunk, n);
+			return true;
+		}
+
+		/** Consumes the next `n` bytes of the response **/
+		bool skip(size_t n) {
+			while (buffer.size() < n)
+				if (!readMore())
+					return false;
+			buffer.erase(0, n);
+			return true;
+		}
+
+		bool skipLine(std::string& line) {
+			size_t end;
+			while ((end = buffer.find("\r\n")) == std::string::npos)
+				if (!readMore())
+					return false;
+			line = buffer.substr(0, end);
+			buffer.erase(0, end + 2);
+			return true;
+		}
+
+		/** @returns the status code or 0 if the connection broke **/
+		int readResponse() {
+			size_t end;
+			while ((end = buffer.find("\r\n\r\n")) == std::string::npos)
+				if (!readMore())
+					return 0;
+			std::string head = buffer.substr(0, end);
+			buffer.erase(0, end + 4);
+			std::transform(head.begin(), head.end(), head.begin(), [](unsigned char c) { return std::tolower(c); });
+			const auto space = head.find(' ');
+			const int status = (space != std::string::npos) ? std::atoi(head.c_str() + space + 1) : 0;
+			auto header = [&head](std::string_view name) -> std::string {
+				auto pos = head.find("\r\n" + std::string(name) + ":");
+				if (pos == std::string::npos)
+					return {};
+				pos += name.size() + 3;
+				return head.substr(pos, head.find("\r\n", pos) - pos);
+			};
+			if (header("transfer-encoding").find("chunked") != std::string::npos) {
+				for (std::string line;;) {
+					if (!skipLine(line))
+						return 0;
+					const auto size = std::strtoull(line.c_str(), nullptr, 16);
+					if (size == 0)
+						break;
+					if (!skip(size + 2))
+						return 0;
+				}
+				// Trailers up to the empty line
+				for (std::string line = "-"; !line.empty();)
+					if (!skipLine(line))
+						return 0;
+			} else if (auto length = header("content-length"); !length.empty()) {
+				if (!skip(std::strtoull(length.c_str(), nullptr, 10)))
+					return 0;
+			} else {
+				while (readMore()) {}
+				close();
+				return status;
+			}
+			if (header("connection").find("close") != std::string::npos)
+				close();
+			return status;
+		}
+
+	public:
+		explicit Connection(const Options& options) noexcept : options(options) {}
+		Connection(const Connection&) = delete;
+		~Connection() { close(); }
+
+		/** @returns the status code of the response or 0 if the request failed **/
+		int get(const std::string& target) {
+			const std::string request = "GET " + target + " HTTP/1.1\r\nHost: " + options.host + "\r\n\r\n";
+			// The server may have closed an idle connection, in which case the request is retried once on a new one
+			for (bool reused = (fd >= 0); fd >= 0 || connect(); reused = false) {
+				bool sent = true;
+				for (size_t off = 0; sent && off < request.size();) {
+					auto n = ::send(fd, request.data() + off, request.size() - off, MSG_NOSIGNAL);
+					sent = n > 0;
+					off += std::max<ssize_t>(n, 0);
+				}
+				if (int status = sent ? readResponse() : 0; status != 0)
+					return status;
+				close();
+				if (!reused)
+					break;
+			}
+			return 0;
+		}
+
+		bool connected() { return fd >= 0 || connect(); }
+	};
+
+	struct Request {
+		std::string target;
+		size_t route;
+	};
+	struct Trace {
+		std::vector<std::string> routes;
+		std::vector<Request> requests;
+
+		void add(std::string target, const std::string& route) {
+			auto it = std::find(routes.begin(), routes.end(), route);
+			if (it == routes.end())
+				it = routes.insert(routes.end(), route);
+			requests.push_back({std::move(target), (size_t)std::distance(routes.begin(), it)});
+		}
+	};
+
+	/** @returns the route of the target, e.g. `/v1/nodes/{nodeid}/effects` for `/v1/nodes/death/effects?limit=10` **/
+	std::string routeOf(std::string_view target) {
+		target = target.substr(0, target.find('?'));
+		std::vector<std::string_view> segments;
+		for (size_t pos = 1; pos <= target.size();) {
+			auto end = std::min(target.find('/', pos), target.size());
+			segments.push_back(target.substr(pos, end - pos));
+			pos = end + 1;
+		}
+		if (segments.size() >= 3 && segments[0] == "v1" && segments[1] == "nodes") {
+			segments[2] = "{nodeid}";
+			if (segments.size() == 5)
+				segments[4] = "{targetid}";
+		} else if (segments.size() == 4 && segments[0] == "v1" && segments[1] == "clueweb") {
+			segments[2] = "{pageid}";
+		}
+		std::string route;
+		for (auto segment : segments)
+			(route += '/') += segment;
+		return route;
+	}
+
+	Trace readTrace(const fs::path& path) {
+		Trace trace;
+		std::ifstream in(path);
+		size_t lineNo = 0;
+		for (std::string line; std::getline(in, line);) {
+			++lineNo;
+			if (line.find_first_not_of(" \t\r") == std::string::npos)
+				continue;
+			rapidjson::Document doc;
+			doc.Parse(line.c_str());
+			auto isString = [&doc](const char* member) { return doc.HasMember(member) && doc[member].IsString(); };
+			if (doc.HasParseError() || !doc.IsObject() || !isString("path") ||
+				(doc.HasMember("method") && !(isString("method") && doc["method"] == "GET"))) {
+				std::cerr << path.string() << ":" << lineNo << ": skipped, only GET requests with a path are replayed"
+						  << std::endl;
+				continue;
+			}
+			std::string target = doc["path"].GetString();
+			trace.add(target, isString("route") ? std::string(doc["route"].GetString()) : routeOf(target));
+		}
+		return trace;
+	}
+
+	std::string urlEncode(std::string_view str) {
+		static constexpr char hex[] = "0123456789ABCDEF";
+		std::string encoded;
+		for (unsigned char c : str) {
+			if (std::isalnum(c) || c == '-' || c == '_' || c == '.' || c == '~') {
+				encoded += c;
+			} else {
+				encoded += '%';
+				encoded += hex[c >> 4];
+				encoded += hex[c & 15];
+			}
+		}
+		return encoded;
+	}
+
+	/**
+	 * @brief Writes a trace of `options.traceLength` requests to `out` that mixes the routes like the frontend does.
+	 * @details Concepts are drawn with a bias towards low indices, which the synthetic graph makes the popular ones.
+	 */
+	void generateTrace(const Causenet& causenet, const Options& options, const fs::path& out) {
+		bench::Random random(options.graph.seed + 2);
+		auto popularConcept = [&] {
+			return (size_t)(causenet.numConcepts() * std::pow(random.uniform(), 2.0)) % causenet.numConcepts();
+		};
+		auto conceptWithEffects = [&] {
+			for (;;)
+				if (auto idx = popularConcept(); causenet.numEffects(idx) > 0)
+					return idx;
+		};
+		auto name = [&](size_t idx) { return urlEncode(causenet.getConceptName(idx)); };
+		const auto graph = causenet.effectGraph();
+		std::ofstream trace(out);
+		for (size_t i = 0; i < options.traceLength; ++i) {
+			std::string path;
+			const auto kind = random.below(100);
+			if (kind < 3) {
+				path = "/v1/nodes?cursor=" + std::to_string(random.below(causenet.numConcepts())) + "&limit=100";
+			} else if (kind < 25) {
+				path = "/v1/nodes/" + name(popularConcept());
+			} else if (kind < 40) {
+				path = "/v1/nodes/" + name(popularConcept()) + "/effects";
+			} else if (kind < 50) {
+				path = "/v1/nodes/" + name(popularConcept()) + "/causes";
+			} else if (kind < 80) {
+				const auto cause = conceptWithEffects();
+				const auto effect = graph.adj[graph.rows[cause] + random.below(causenet.numEffects(cause))];
+				path = "/v1/nodes/" + name(cause) + "/effects/" + name(effect);
+				if (random.below(2) == 0)
+					path += "?limit=10&sourceType=" + std::to_string(random.below(causenet::numSourceTypes));
+			} else if (kind < 90) {
+				path = "/v1/nodes/" + name(popularConcept()) + "/path-to/" + name(popularConcept());
+			} else {
+				const auto page = bench::clueWebId(random.below(options.graph.numClueWebPages));
+				path = "/v1/clueweb/" + page + ((kind < 95) ? "/info" : "/content");
+			}
+			trace << "{\"path\":\"" << path << "\"}\n";
+		}
+	}
+
+	/** Prepares the server's working directory: the data set, the fake ClueWeb12 parts, their index and the config **/
+	void prepareWorkdir(const Options& options) {
+		const auto workdir = fs::absolute(options.workdir);
+		const auto graph = bench::synthetic(options.graph, workdir);
+		fs::create_directories(workdir / ".data");
+		const auto dataset = workdir / ".data" / "causenet-full-supported-reworked.causenet";
+		fs::remove(dataset);
+		fs::create_symlink(graph, dataset);
+
+		auto parts = graph;
+		parts.replace_extension(".clueweb");
+		if (!fs::exists(parts / ".complete")) {
+			fs::remove_all(parts);
+			bench::writeFakeClueWeb(options.graph, parts);
+			std::ofstream(parts / ".complete");
+		}
+		auto index = parts;
+		index.replace_extension(".warcidx");
+		if (!fs::exists(index))
+			warc::v1::buildIndex(parts, index);
+		fs::remove(workdir / ".data" / "clueweb12.warcidx");
+		if (options.clueWebIndex)
+			fs::create_symlink(index, workdir / ".data" / "clueweb12.warcidx");
+
+		std::ofstream config(workdir / "config.dev.yml");
+		config << "custom_config:\n"
+			   << "  port: " << options.port << "\n"
+			   << "  clueweb_dir: " << parts.string() << "\n"
+			   << "  response_cache:\n"
+			   << "    enabled: " << (options.cache ? "true" : "false") << "\n";
+	}
+
+	/** Starts the server within the working directory and waits until it accepts connections **/
+	pid_t startServer(const Options& options) {
+		const auto server = fs::absolute(options.server);
+		const auto workdir = fs::absolute(options.workdir);
+		pid_t pid = ::fork();
+		if (pid == 0) {
+			if (::chdir(workdir.c_str()) != 0)
+				::_exit(127);
+			int log = ::open("server.log", O_WRONLY | O_CREAT | O_TRUNC, 0644);
+			::dup2(log, STDOUT_FILENO);
+			::dup2(log, STDERR_FILENO);
+			::execl(server.c_str(), server.c_str(), "config.dev.yml", nullptr);
+			::_exit(127);
+		}
+		Connection probe(options);
+		for (auto deadline = Clock::now() + std::chrono::minutes(5); Clock::now() < deadline;) {
+			if (probe.connected())
+				return pid;
+			if (int status; ::waitpid(pid, &status, WNOHANG) == pid) {
+				std::cerr << "The server exited during startup; see " << (workdir / "server.log").string() << std::endl;
+				return -1;
+			}
+			std::this_thread::sleep_for(std::chrono::milliseconds(100));
+		}
+		::kill(pid, SIGKILL);
+		::waitpid(pid, nullptr, 0);
+		std::cerr << "The server did not accept connections within 5 minutes" << std::endl;
+		return -1;
+	}
+
+	struct RouteStats {
+		std::vector<std::uint64_t> latencies; ///< In nanoseconds, of the successful requests
+		size_t errors = 0;
+	};
+
+	/** Replays the trace `options.repeat` times with `options.concurrency` connections **/
+	std::vector<RouteStats> replay(const Trace& trace, const Options& options, double& seconds) {
+		for (size_t i = 0; i < options.warmup; ++i) {
+			Connection warmup(options);
+			warmup.get(trace.requests[i % trace.requests.size()].target);
+		}
+		const size_t total = trace.requests.size() * options.repeat;
+		std::atomic<size_t> next = 0;
+		const auto numRoutes = trace.routes.size();
+		std::vector<std::vector<RouteStats>> perThread(options.concurrency, std::vector<RouteStats>(numRoutes));
+		const auto start = Clock::now();
+		std::vector<std::thread> threads;
+		for (unsigned t = 0; t < options.concurrency; ++t) {
+			threads.emplace_back([&, t] {
+				Connection connection(options);
+				auto& stats = perThread[t];
+				for (size_t i; (i = next.fetch_add(1, std::memory_order_relaxed)) < total;) {
+					const auto& request = trace.requests[i % trace.requests.size()];
+					const auto before = Clock::now();
+					const int status = connection.get(request.target);
+					const auto latency = std::chrono::duration_cast<std::chrono::nanoseconds>(Clock::now() - before);
+					if (status >= 200 && status < 300)
+						stats[request.route].latencies.push_back(latency.count());
+					else
+						stats[request.route].errors++;
+				}
+			});
+		}
+		for (auto& thread : threads)
+			thread.join();
+		seconds = std::chrono::duration<double>(Clock::now() - start).count();
+
+		std::vector<RouteStats> merged(trace.routes.size());
+		for (auto& stats : perThread) {
+			for (size_t r = 0; r < stats.size(); ++r) {
+				merged[r].latencies.insert(
+						merged[r].latencies.end(), stats[r].latencies.begin(), stats[r].latencies.end()
+				);
+				merged[r].errors += stats[r].errors;
+			}
+		}
+		return merged;
+	}
+
+	void report(const std::vector<std::string>& routes, std::vector<RouteStats>& stats, double seconds) {
+		auto percentile = [](const std::vector<std::uint64_t>& sorted, double q) {
+			if (sorted.empty())
+				return 0.0;
+			return sorted[std::min(sorted.size() - 1, (size_t)(q * sorted.size()))] / 1e6;
+		};
+		auto line = [&](const std::string& route, RouteStats& s) {
+			std::sort(s.latencies.begin(), s.latencies.end());
+			std::printf(
+					"%-45s %10zu %8zu %10.1f %9.3f %9.3f %9.3f\n", route.c_str(), s.latencies.size() + s.errors,
+					s.errors, (s.latencies.size() + s.errors) / seconds, percentile(s.latencies, 0.5),
+					percentile(s.latencies, 0.99), percentile(s.latencies, 0.999)
+			);
+		};
+		std::printf(
+				"%-45s %10s %8s %10s %9s %9s %9s\n", "route", "requests", "errors", "req/s", "p50 ms", "p99 ms",
+				"p999 ms"
+		);
+		RouteStats all;
+		for (size_t r = 0; r < routes.size(); ++r) {
+			line(routes[r], stats[r]);
+			all.latencies.insert(all.latencies.end(), stats[r].latencies.begin(), stats[r].latencies.end());
+			all.errors += stats[r].errors;
+		}
+		line("total", all);
+		std::printf("%.2f s\n", seconds);
+	}
+
+	bool parseArgs(int argc, char* argv[], Options& options) {
+		for (int i = 1; i < argc; ++i) {
+			std::string arg = argv[i];
+			if (arg == "--no-cache" || arg == "--no-clueweb-index") {
+				(arg == "--no-cache" ? options.cache : options.clueWebIndex) = false;
+				continue;
+			}
+			if (i + 1 >= argc)
+				return false;
+			std::string value = argv[++i];
+			if (arg == "--server") {
+				options.server = value;
+			} else if (arg == "--url") {
+				// host:port, optionally prefixed with http://
+				if (value.starts_with("http://"))
+					value = value.substr(7);
+				auto colon = value.rfind(':');
+				if (colon == std::string::npos)
+					return false;
+				options.host = value.substr(0, colon);
+				options.port = std::stoul(value.substr(colon + 1));
+				options.external = true;
+			} else if (arg == "--port") {
+				options.port = std::stoul(value);
+			} else if (arg == "--workdir") {
+				options.workdir = value;
+			} else if (arg == "--trace") {
+				options.trace = value;
+			} else if (arg == "--trace-length") {
+				options.traceLength = std::stoull(value);
+			} else if (arg == "--concurrency") {
+				options.concurrency = std::stoul(value);
+			} else if (arg == "--repeat") {
+				options.repeat = std::stoull(value);
+			} else if (arg == "--warmup") {
+				options.warmup = std::stoull(value);
+			} else if (arg == "--nodes") {
+				options.graph.numNodes = std::stoull(value);
+			} else if (arg == "--seed") {
+				options.graph.seed = std::stoull(value);
+			} else {
+				return false;
+			}
+		}
+		return (options.external || !options.server.empty()) && options.concurrency > 0 && options.repeat > 0 &&
+			   options.graph.numNodes >= 2;
+	}
+} // namespace
+
+int main(int argc, char* argv[]) {
+	Options options;
+	if (!parseArgs(argc, argv, options)) {
+		std::cerr << "Usage: " << argv[0]
+				  << " (--server <causenetexe> | --url <host:port>) [--trace <trace.jsonl> | --trace-length <n>]"
+					 " [--concurrency <n>] [--repeat <n>] [--warmup <n>] [--nodes <n>] [--seed <n>] [--port <n>]"
+					 " [--workdir <dir>] [--no-cache] [--no-clueweb-index]"
+				  << std::endl;
+		return 1;
+	}
+	fs::create_directories(options.workdir);
+	if (!options.external)
+		prepareWorkdir(options);
+	if (options.trace.empty()) {
+		// The trace refers to the concepts of the synthetic graph
+		options.trace = options.workdir / "trace.jsonl";
+		generateTrace(Causenet::fromFile(bench::synthetic(options.graph, options.workdir)), options, options.trace);
+	}
+	auto trace = readTrace(options.trace);
+	if (trace.requests.empty()) {
+		std::cerr << "The trace " << options.trace.string() << " contains no requests" << std::endl;
+		return 1;
+	}
+
+	pid_t server = -1;
+	if (!options.external && (server = startServer(options)) < 0)
+		return 1;
+	double seconds;
+	auto stats = replay(trace, options, seconds);
+	if (server > 0) {
+		::kill(server, SIGTERM);
+		::waitpid(server, nullptr, 0);
+	}
+	report(trace.routes, stats, seconds);
+	return 0;
+}
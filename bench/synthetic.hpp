@@ -0,0 +1,190 @@
+#ifndef CAUSENET_BENCH_SYNTHETIC_HPP
+#define CAUSENET_BENCH_SYNTHETIC_HPP
+
+#include <causenet/causenet_writer.hpp>
+#include <causenet/support.hpp>
+
+#include <algorithm>
+#include <array>
+#include <cinttypes>
+#include <cmath>
+#include <cstdio>
+#include <filesystem>
+#include <string>
+#include <vector>
+
+#include <zlib.h>
+
+namespace bench {
+	/**
+	 * @brief Shape of a synthetic CauseNet; the same configuration always yields the same graph.
+	 * @details Out-degrees and the number of supports per edge follow discrete Pareto distributions like those of the
+	 * real data: most concepts have a single effect while a few have thousands. Effects are skewed towards low node
+	 * indices such that, as with "death" or "cancer", a few concepts are the effect of many others.
+	 */
+	struct SyntheticConfig {
+		size_t numNodes = 100000;
+		unsigned minDegree = 1;
+		unsigned maxDegree = 5000;
+		double degreeExponent = 2.1; ///< Exponent of the degree density; smaller values give a heavier tail
+		double targetSkew = 2.0;	 ///< Effects are drawn as `numNodes * u^targetSkew` for uniform `u`
+		unsigned maxSupport = 200;
+		double supportExponent = 2.5;
+		unsigned sentenceWords = 24;
+		size_t numClueWebPages = 20000; ///< The ClueWeb12 supports are spread over this many pages
+		std::uint64_t seed = 42;
+		bool compress = false; ///< Stores the sources zstd-compressed; the graph and supports are the same
+
+		/** @returns a file name that identifies the configuration **/
+		std::string fileName() const {
+			return "synthetic-n" + std::to_string(numNodes) + "-d" + std::to_string(minDegree) + "-" +
+				   std::to_string(maxDegree) + "-a" + std::to_string(degreeExponent) + "-t" +
+				   std::to_string(targetSkew) + "-s" + std::to_string(maxSupport) + "-" +
+				   std::to_string(supportExponent) + "-w" + std::to_string(sentenceWords) + "-c" +
+				   std::to_string(numClueWebPages) + "-r" + std::to_string(seed) + (compress ? "-z" : "") + ".causenet";
+		}
+	};
+
+	/** @brief SplitMix64; unlike <random>'s distributions, it yields the same numbers with every standard library **/
+	class Random final {
+	private:
+		std::uint64_t state;
+
+	public:
+		explicit Random(std::uint64_t seed) noexcept : state(seed) {}
+
+		std::uint64_t next() noexcept {
+			std::uint64_t z = (state += 0x9e3779b97f4a7c15ull);
+			z = (z ^ (z >> 30)) * 0xbf58476d1ce4e5b9ull;
+			z = (z ^ (z >> 27)) * 0x94d049bb133111ebull;
+			return z ^ (z >> 31);
+		}
+		/** Uniform in (0, 1] **/
+		double uniform() noexcept { return ((next() >> 11) + 1) * 0x1.0p-53; }
+		/** Uniform in [0, n) **/
+		std::uint64_t below(std::uint64_t n) noexcept { return (std::uint64_t)(((unsigned __int128)next() * n) >> 64); }
+		/** Discrete Pareto distribution with the given density exponent on [min, max] **/
+		unsigned pareto(unsigned min, double exponent, unsigned max) noexcept {
+			return (unsigned)std::min<double>(max, std::floor(min * std::pow(uniform(), -1.0 / (exponent - 1))));
+		}
+	};
+
+	/** @returns the i-th of the words that names and sentences are built from, e.g. "kalome" **/
+	inline std::string word(size_t i) {
+		static constexpr std::array<const char*, 16> syllables = {"ka", "lo", "me", "ri", "tu", "sa", "ne", "vo",
+																  "di", "pa", "ge", "mu", "zo", "fi", "ha", "be"};
+		std::string word;
+		do {
+			word += syllables[i % syllables.size()];
+			i /= syllables.size();
+		} while (i != 0);
+		return word + syllables[word.size() % syllables.size()];
+	}
+	static constexpr size_t vocabularySize = 4096;
+
+	/** @returns the unique name of node i consisting of one to three words, e.g. "kalome risa" **/
+	inline std::string conceptName(size_t i) {
+		std::string name = word(i % vocabularySize);
+		for (i /= vocabularySize; i != 0; i /= vocabularySize)
+			name += " " + word(i % vocabularySize);
+		return name;
+	}
+
+	static constexpr size_t pagesPerSegment = 1000;
+	static constexpr size_t segmentsPerDirectory = 100;
+
+	/** @returns the TREC-ID of the i-th page of the fake ClueWeb12, e.g. "clueweb12-0000tw-03-00042" **/
+	inline std::string clueWebId(size_t page) {
+		char id[32];
+		std::snprintf(
+				id, sizeof(id), "clueweb12-%04zutw-%02zu-%05zu", page / (pagesPerSegment * segmentsPerDirectory),
+				page / pagesPerSegment % segmentsPerDirectory, page % pagesPerSegment
+		);
+		return id;
+	}
+
+	/**
+	 * @brief Writes the pages of the synthetic graph's ClueWeb12 supports in the layout of the ClueWeb12 parts, i.e.
+	 * `ClueWeb12_00/0000tw/0000tw-03.warc.gz`, such that it can stand in for the real corpus.
+	 */
+	inline void writeFakeClueWeb(const SyntheticConfig& config, const std::filesystem::path& partsDir) {
+		Random random(config.seed ^ 0xc1e0eb12);
+		gzFile segment = nullptr;
+		for (size_t page = 0; page < config.numClueWebPages; ++page) {
+			const auto id = clueWebId(page);
+			if (page % pagesPerSegment == 0) {
+				if (segment != nullptr)
+					gzclose(segment);
+				const auto dir = id.substr(10, 6);
+				const auto path = partsDir / ("ClueWeb12_" + dir.substr(0, 2)) / dir / (id.substr(10, 9) + ".warc.gz");
+				std::filesystem::create_directories(path.parent_path());
+				segment = gzopen(path.c_str(), "wb");
+			}
+			std::string content = "HTTP/1.1 200 OK\r\nContent-Type: text/html\r\n\r\n<html><body><p>";
+			for (unsigned w = 0; w < 20 * config.sentenceWords; ++w)
+				content += word(random.below(vocabularySize)) + ((w % config.sentenceWords == 0) ? ". " : " ");
+			content += "http://example.com/" + id + "</p></body></html>";
+			const auto record = "WARC/1.0\r\nWARC-Type: response\r\nWARC-TREC-ID: " + id +
+								"\r\nWARC-Target-URI: http://example.com/" + id +
+								"\r\nContent-Length: " + std::to_string(content.size()) + "\r\n\r\n" + content +
+								"\r\n\r\n";
+			gzwrite(segment, record.data(), (unsigned)record.size());
+		}
+		if (segment != nullptr)
+			gzclose(segment);
+	}
+
+	/** Writes the graph described by `config` to `outfile` using internal::CausenetWriter **/
+	inline void writeSynthetic(const SyntheticConfig& config, const std::filesystem::path& outfile) {
+		Random random(config.seed);
+		causenet::internal::CausenetWriter writer(outfile, config.compress);
+		std::vector<causenet::Support> supports;
+		for (size_t cause = 0; cause < config.numNodes; ++cause) {
+			const auto degree = random.pareto(config.minDegree, config.degreeExponent, config.maxDegree);
+			const auto causeName = conceptName(cause);
+			for (unsigned i = 0; i < degree; ++i) {
+				auto effect = (size_t)(config.numNodes * std::pow(random.uniform(), config.targetSkew));
+				effect = std::min(effect, config.numNodes - 1);
+				if (effect == cause)
+					continue;
+				const auto effectName = conceptName(effect);
+				supports.resize(random.pareto(1, config.supportExponent, config.maxSupport));
+				for (auto& support : supports) {
+					// Most supports of the real data stem from ClueWeb12
+					const auto type = random.below(10);
+					support.sourceTypeId = (type < 7)	? causenet::SourceType::ClueWeb12Sentence
+										   : (type < 9) ? causenet::SourceType::WikipediaSentence
+														: static_cast<causenet::SourceType>(random.below(2));
+					support.id = (support.sourceTypeId == causenet::SourceType::ClueWeb12Sentence)
+										 ? clueWebId(random.below(config.numClueWebPages))
+										 : std::to_string(random.below(70000000));
+					support.content.clear();
+					const auto position = random.below(config.sentenceWords);
+					for (unsigned w = 0; w < config.sentenceWords; ++w) {
+						support.content += (w == position) ? causeName + " causes " + effectName
+														   : word(random.below(vocabularySize));
+						support.content += (w + 1 < config.sentenceWords) ? ' ' : '.';
+					}
+				}
+				writer.writeEdge(causeName, effectName, supports);
+			}
+		}
+	}
+
+	/** @returns the path of the synthetic file for `config` within `dir`, which is generated on first use **/
+	inline std::filesystem::path synthetic(const SyntheticConfig& config, const std::filesystem::path& dir) {
+		std::filesystem::create_directories(dir);
+		auto path = dir / config.fileName();
+		if (!std::filesystem::exists(path)) {
+			// The writer places its temporary files next to the output
+			auto scratch = dir / (config.fileName() + ".tmp");
+			std::filesystem::create_directories(scratch);
+			writeSynthetic(config, scratch / config.fileName());
+			std::filesystem::rename(scratch / config.fileName(), path);
+			std::filesystem::remove_all(scratch);
+		}
+		return path;
+	}
+} // namespace bench
+
+#endif
@@ -1,35 +1,238 @@
 #ifndef CAUSENET_CAUSENET_HPP
 #define CAUSENET_CAUSENET_HPP
 
+#include <chrono>
+#include <cinttypes>
+#include <cstring>
 #include <filesystem>
+#include <iterator>
+#include <memory>
+#include <ranges>
+#include <span>
 #include <string>
+#include <string_view>
+#include <thread>
 #include <tuple>
 #include <vector>
 
-#include "../utils/generator.hpp"
+#include "../utils/csr.hpp"
+#include "../utils/reorder.hpp"
 #include "./support.hpp"
 
 namespace causenet {
+	/**
+	 * @brief How long an edge is for the path searches.
+	 * @details Except for Hops, the lengths are precomputed when converting and stored quantized (see edgeWeights()).
+	 */
+	enum class EdgeWeighting : std::uint8_t {
+		Hops,			   ///< Every edge has length 1
+		InverseSupport,	   ///< Inversely proportional to the number of supports
+		NegLogConfidence,  ///< `-log(p)` where `p` is the edge's share of the supports of all effects of its cause
+		SourceTypeWeighted ///< Like InverseSupport but curated sources (e.g., infoboxes) count more than sentences
+	};
+	static constexpr std::size_t numEdgeWeightings = 4;
+
+	inline constexpr std::string_view edgeWeightingName(EdgeWeighting weighting) noexcept {
+		constexpr std::string_view names[] = {"hops", "inverse_support", "neg_log_confidence", "source_type"};
+		return names[static_cast<std::uint8_t>(weighting)];
+	}
+	/** @returns false if `name` is none of the edgeWeightingName()s **/
+	inline constexpr bool parseEdgeWeighting(std::string_view name, EdgeWeighting& weighting) noexcept {
+		for (std::uint8_t w = 0; w < numEdgeWeightings; ++w) {
+			if (edgeWeightingName(static_cast<EdgeWeighting>(w)) == name) {
+				weighting = static_cast<EdgeWeighting>(w);
+				return true;
+			}
+		}
+		return false;
+	}
+
+	/**
+	 * @brief Random-access range over the effects (or causes) of a concept and their number of supports.
+	 * @details Reads the adjacency of the mapped file in place: `nodes` points to the row's neighbors and `supports`
+	 * to the SupportRefs (of `supportStride` bytes, starting with the uint32 number of supports) of the row's edges.
+	 * Rows of the transposed adjacency set `edgeIds` instead, which locate each entry's SupportRef from the first one.
+	 */
+	class EdgeRange : public std::ranges::view_interface<EdgeRange> {
+	public:
+		using value_type = std::tuple<std::size_t, unsigned>; ///< The neighbor and the number of supports
+		static constexpr std::size_t supportStride = 16;
+
+	private:
+		struct Location {
+			const std::uint32_t* nodes = nullptr;
+			const std::uint64_t* edgeIds = nullptr;
+			const char* supports = nullptr;
+
+			value_type decode(std::size_t i) const noexcept {
+				std::uint32_t numSupport;
+				const auto edge = (edgeIds != nullptr) ? edgeIds[i] : i;
+				std::memcpy(&numSupport, supports + edge * supportStride, sizeof(numSupport));
+				return {nodes[i], numSupport};
+			}
+		};
+
+		Location location;
+		std::size_t count = 0;
+
+	public:
+		/** Only refers to the mapped file such that it stays valid after the range is gone **/
+		class Iterator {
+		private:
+			Location location;
+			std::ptrdiff_t idx = 0;
+
+		public:
+			using iterator_concept = std::random_access_iterator_tag;
+			using iterator_category = std::input_iterator_tag; ///< operator* returns a prvalue
+			using value_type = EdgeRange::value_type;
+			using difference_type = std::ptrdiff_t;
+
+			Iterator() noexcept = default;
+			Iterator(const Location& location, std::ptrdiff_t idx) noexcept : location(location), idx(idx) {}
+
+			value_type operator*() const noexcept { return location.decode(idx); }
+			value_type operator[](difference_type n) const noexcept { return location.decode(idx + n); }
+
+			Iterator& operator++() noexcept { return ++idx, *this; }
+			Iterator operator++(int) noexcept {
+				auto it = *this;
+				++idx;
+				return it;
+			}
+			Iterator& operator--() noexcept { return --idx, *this; }
+			Iterator operator--(int) noexcept {
+				auto it = *this;
+				--idx;
+				return it;
+			}
+			Iterator& operator+=(difference_type n) noexcept { return idx += n, *this; }
+			Iterator& operator-=(difference_type n) noexcept { return idx -= n, *this; }
+			friend Iterator operator+(Iterator it, difference_type n) noexcept { return it += n; }
+			friend Iterator operator+(difference_type n, Iterator it) noexcept { return it += n; }
+			friend Iterator operator-(Iterator it, difference_type n) noexcept { return it -= n; }
+			friend difference_type operator-(const Iterator& a, const Iterator& b) noexcept { return a.idx - b.idx; }
+
+			bool operator==(const Iterator& other) const noexcept { return idx == other.idx; }
+			auto operator<=>(const Iterator& other) const noexcept { return idx <=> other.idx; }
+		};
+
+		EdgeRange() noexcept = default;
+		EdgeRange(
+				const std::uint32_t* nodes, const std::uint64_t* edgeIds, const char* supports, std::size_t count
+		) noexcept
+				: location{.nodes = nodes, .edgeIds = edgeIds, .supports = supports}, count(count) {}
+
+		std::size_t size() const noexcept { return count; }
+		Iterator begin() const noexcept { return {location, 0}; }
+		Iterator end() const noexcept { return {location, static_cast<std::ptrdiff_t>(count)}; }
+		value_type operator[](std::size_t i) const noexcept { return location.decode(i); }
+	};
+	static_assert(std::ranges::random_access_range<EdgeRange>);
+	static_assert(std::ranges::sized_range<EdgeRange>);
+
+	/**
+	 * @brief How Causenet::fromFile() brings the mapped file into memory before the first request needs it.
+	 * @details The topology are the sections that every traversal reads: the node table, the name index, the Edge*
+	 * and Cause* sections, the SupportTypeCounts and the EdgeWeights*. The supports are only read per edge and stay
+	 * on demand. Locking and huge pages are best effort; see LoadStats for what was achieved. By default, the pages are
+	 * only read once they are accessed.
+	 */
+	struct LoadOptions {
+		bool populate = false; ///< Maps the whole file with MAP_POPULATE, i.e., reads it completely while loading
+		bool prefault = false; ///< Touches every page of the topology while loading
+		bool advise = false;   ///< madvise()s the topology as MADV_WILLNEED and everything else as MADV_RANDOM
+		bool lock = false;	   ///< mlock()s the topology; needs a sufficient RLIMIT_MEMLOCK
+		/** Copies the topology into anonymous memory backed by transparent huge pages, which costs as much memory **/
+		bool hugePages = false;
+	};
+
+	/** @brief What Causenet::fromFile() did to warm up the file (see LoadOptions) **/
+	struct LoadStats {
+		std::chrono::milliseconds duration{0}; ///< Of loading, including the warmup
+		std::size_t topologyBytes = 0;		   ///< Of the topology within the mapped file
+		std::size_t lockedBytes = 0;
+		std::size_t hugePageBytes = 0; ///< Of the topology that was copied into huge pages
+	};
+
 	struct CausenetFile;
+	struct CausenetLayout;
 	class Causenet final {
 	private:
 		int fd;
+		std::size_t size;
 		const CausenetFile& file;
+		LoadStats stats; ///< Filled in while constructing the layout
+		std::unique_ptr<const CausenetLayout> layout; ///< nullptr once moved from, which then owns no mapping
 
-		Causenet(const std::filesystem::path& path);
+		Causenet(const std::filesystem::path& path, const LoadOptions& options);
 
 	public:
-		size_t getConceptIdx(std::string name) const noexcept;
+		Causenet(const Causenet&) = delete;
+		Causenet(Causenet&&) noexcept;
+		/** Unmaps the file; views into it (e.g., from getConceptName() or getSupportViews()) become invalid **/
+		~Causenet();
+
+		/** @returns the version of the opened file; version 1 files are served from an in-memory copy of the edges **/
+		unsigned formatVersion() const noexcept;
+		const LoadStats& loadStats() const noexcept;
+
+		size_t getConceptIdx(std::string_view name) const noexcept;
 		const std::string getConceptByIdx(size_t idx) const noexcept;
+		/** Zero-copy variant of getConceptByIdx() that views the name within the mapped file **/
+		std::string_view getConceptName(size_t idx) const noexcept;
 		size_t numConcepts() const noexcept;
-		Generator<std::string> getConcepts() const noexcept;
-		Generator<std::tuple<size_t, unsigned>> getEffects(size_t conceptIdx) const noexcept;
+		/** The getConceptName()s of all concepts in the order of their indices **/
+		auto getConcepts() const noexcept {
+			return std::views::iota(size_t{0}, numConcepts()) |
+				   std::views::transform([this](size_t idx) { return getConceptName(idx); });
+		}
+		EdgeRange getEffects(size_t conceptIdx) const noexcept;
 		size_t numEffects(size_t conceptIdx) const noexcept;
+		EdgeRange getCauses(size_t conceptIdx) const noexcept;
+		size_t numCauses(size_t conceptIdx) const noexcept;
+		/** The edge ids of the effect graph are the positions within its adjacency **/
+		utils::CSRGraph effectGraph() const noexcept;
+		/** Transpose of the effectGraph(); CSRGraph::edgeId maps into the effect graph's edge ids **/
+		utils::CSRGraph causeGraph() const noexcept;
+		unsigned numSupport(size_t edgeId) const noexcept;
+		/**
+		 * @brief The lengths of the effect graph's edges under `weighting`, indexed by edge id.
+		 * @returns an empty span for EdgeWeighting::Hops, whose lengths are all 1
+		 */
+		std::span<const std::uint16_t> edgeWeights(EdgeWeighting weighting) const noexcept;
+		/**
+		 * Supports of the edge without copying them out of the file; empty if there is no such edge. See SupportView
+		 * for how long the views stay valid.
+		 */
+		SupportRange getSupportViews(size_t causeIdx, size_t effectIdx) const noexcept;
+		/** The supports of the given type only; a slice of getSupportViews() since each edge's are grouped by type **/
+		SupportRange getSupportViews(size_t causeIdx, size_t effectIdx, SourceType type) const noexcept;
 		std::vector<Support> getSupport(size_t causeIdx, size_t effectIdx) const noexcept;
 
-		static Causenet fromFile(const std::filesystem::path& path);
-		static void jsonlToBinary(const std::filesystem::path& inJsonl, const std::filesystem::path& outBinary);
+		/**
+		 * @throws std::runtime_error if the file cannot be mapped or its structure is inconsistent, e.g., since it is
+		 * truncated; the supports are only checked when they are decoded (see SupportRange)
+		 */
+		static Causenet fromFile(const std::filesystem::path& path, const LoadOptions& options = {});
+		static void jsonlToBinary(
+				const std::filesystem::path& inJsonl, const std::filesystem::path& outBinary,
+				unsigned numThreads = std::thread::hardware_concurrency(), size_t memoryLimit = 0,
+				bool compressSupports = false, utils::NodeOrdering ordering = utils::NodeOrdering::Input
+		);
+		/**
+		 * @brief Writes the graph of `inBinary` to `outBinary` with its concepts renumbered by utils::nodeOrder().
+		 * @details Neighboring concepts are stored close to each other such that traversals touch fewer pages.
+		 * `memoryLimit` and `compressSupports` are as for jsonlToBinary().
+		 */
+		static void reorder(
+				const std::filesystem::path& inBinary, const std::filesystem::path& outBinary,
+				utils::NodeOrdering ordering, size_t memoryLimit = 0, bool compressSupports = false
+		);
 	};
 } // namespace causenet
 
+template <>
+inline constexpr bool std::ranges::enable_borrowed_range<causenet::EdgeRange> = true;
+
 #endif
\ No newline at end of file
@@ -0,0 +1,85 @@
+#ifndef CAUSENET_LANDMARKS_HPP
+#define CAUSENET_LANDMARKS_HPP
+
+#include "../utils/landmarks.hpp"
+#include "./causenet.hpp"
+
+#include <cinttypes>
+#include <filesystem>
+#include <memory>
+#include <span>
+#include <thread>
+
+namespace causenet {
+	/**
+	 * "CNETALT3"; older files are rejected. "CNETALT1" files lack LandmarkHeader::weighting and hold distances over the
+	 * raw support counts, which are no lower bounds under any EdgeWeighting, "CNETALT2" files lack the fingerprint.
+	 */
+	static constexpr std::uint64_t landmarkMagic = 0x33544C4154454E43ull;
+
+	/**
+	 * @brief Header of a landmark file.
+	 * @details It is followed by the `numLandmarks` landmark nodes (padded to 8 bytes) and the `from` and `to`
+	 * distances of utils::Landmarks, each `numNodes * numLandmarks` uint32_t in node-major order. `numNodes`,
+	 * `numEdges` and `fingerprint` identify the graph that the distances were computed on; the counts alone do not
+	 * tell apart a graph from its renumbered copy (see utils::NodeOrdering).
+	 */
+	struct __attribute__((packed)) LandmarkHeader {
+		std::uint64_t magic;
+		std::uint64_t numNodes;
+		std::uint64_t numEdges;
+		std::uint32_t numLandmarks;
+		EdgeWeighting weighting; ///< The lengths of the edges that the distances are made of
+		std::uint8_t reserved[3];
+		/** Hash of the edges and their lengths under `weighting` (see LandmarkIndex::fingerprint()) **/
+		std::uint64_t fingerprint;
+	};
+	static_assert(sizeof(LandmarkHeader) == 40);
+
+	/**
+	 * @brief Memory mapped landmark distances of a Causenet created by build().
+	 * @details The distances only bound the lengths of paths under the EdgeWeighting that they were computed with
+	 * (see LandmarkHeader::weighting).
+	 */
+	class LandmarkIndex final {
+	private:
+		int fd;
+		const char* data;
+		std::size_t size;
+
+		LandmarkIndex(int fd, const char* data, std::size_t size) noexcept;
+
+	public:
+		LandmarkIndex(const LandmarkIndex&) = delete;
+		~LandmarkIndex();
+
+		/**
+		 * @returns the index or nullptr if the file does not exist, is not a valid landmark file or was computed on
+		 * another graph than `causenet`
+		 */
+		static std::unique_ptr<LandmarkIndex> open(const std::filesystem::path& path, const Causenet& causenet);
+
+		const LandmarkHeader& header() const noexcept { return *reinterpret_cast<const LandmarkHeader*>(data); }
+		std::span<const std::uint32_t> landmarks() const noexcept;
+		utils::LandmarkBounds bounds() const noexcept;
+
+		/**
+		 * @brief Hash of the EdgeRows and EdgeTargets of `causenet` and of the lengths of its edges under `weighting`.
+		 * @details Reads the whole topology, which the warmup (see LoadOptions) brings into memory anyway.
+		 */
+		static std::uint64_t fingerprint(const Causenet& causenet, EdgeWeighting weighting) noexcept;
+
+		/**
+		 * @brief Chooses `numLandmarks` landmarks of `causenet` and writes their distances under `weighting` to `out`.
+		 * @details The searches of the landmarks run on `numThreads` threads (see utils::selectLandmarks()).
+		 * @throws std::runtime_error if the file cannot be written
+		 */
+		static void build(
+				const Causenet& causenet, const std::filesystem::path& out, size_t numLandmarks,
+				utils::LandmarkSelection selection, EdgeWeighting weighting,
+				unsigned numThreads = std::thread::hardware_concurrency()
+		);
+	};
+} // namespace causenet
+
+#endif
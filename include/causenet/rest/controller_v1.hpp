@@ -1,42 +1,124 @@
 #pragma once
 
 #include <causenet/causenet.hpp>
+#include <causenet/landmarks.hpp>
+#include <utils/sharded_cache.hpp>
+#include <utils/shortest_paths.hpp>
+#include <utils/worker_pool.hpp>
+#include <warc_index.hpp>
 
 #include <drogon/HttpController.h>
+#include <drogon/utils/coroutine.h>
 
+#include <chrono>
+#include <cinttypes>
+#include <filesystem>
 #include <memory>
+#include <string>
+#include <utility>
+#include <vector>
 
-struct CausenetWrapper {
-private:
-	causenet::Causenet causenet;
+namespace causenet::rest::v1 {
+	/** @brief Identifies the version of a file that a Snapshot was loaded from; replacing the file changes it **/
+	struct FileIdentity {
+		std::uint64_t device = 0, inode = 0;
+		std::int64_t modified = 0; ///< Nanoseconds since the epoch
+		std::uint64_t size = 0;
+
+		/** @returns the identity of the file at `path` or the default one if it does not exist **/
+		static FileIdentity of(const std::filesystem::path& path) noexcept;
+		bool operator==(const FileIdentity&) const noexcept = default;
+	};
 
-public:
-	CausenetWrapper(std::filesystem::path path) : causenet(causenet::Causenet::fromFile(path)) {}
+	/**
+	 * @brief A loaded graph together with everything derived from it.
+	 * @details Every request holds the snapshot that was current when it started (see Controller::snapshot()) such
+	 * that a reload never changes the graph underneath it. The file is unmapped when the last of them is done.
+	 */
+	struct Snapshot {
+		causenet::Causenet causenet;
+		/**
+		 * Optional; with it, getPath runs A* guided by the landmarks instead of the bidirectional search whenever it
+		 * searches with the landmarks' weighting
+		 */
+		std::unique_ptr<causenet::LandmarkIndex> landmarks;
+		/** Counts the snapshots since the start; part of the keys of the ResponseCache **/
+		std::uint64_t generation;
+		FileIdentity causenetFile, landmarkFile;
+
+		Snapshot(causenet::Causenet&& causenet, std::uint64_t generation) noexcept;
+		Snapshot(const Snapshot&) = delete;
+		~Snapshot();
+
+		/** The number of snapshots still referenced, i.e., the current one and those of unfinished requests **/
+		static size_t numAlive() noexcept;
+	};
 
-	causenet::Causenet& get() { return causenet; }
-};
+	/** @brief A successful response as replayed by the ResponseCache **/
+	struct CachedResponse {
+		drogon::ContentType contentType;
+		std::vector<std::pair<std::string, std::string>> headers;
+		std::string body;
+	};
+	/** Serialized responses of the read-only routes keyed by the route and its normalized parameters **/
+	using ResponseCache = utils::ShardedCache<std::shared_ptr<const CachedResponse>>;
 
-namespace causenet::rest::v1 {
 	class Controller : public drogon::HttpController<Controller> {
 		using DRCallback = std::function<void(const drogon::HttpResponsePtr&)>;
 
 	public:
-		static std::unique_ptr<CausenetWrapper> causenet;
+		/** The graph is read from `custom_config.causenet`, the landmarks from `custom_config.landmarks` **/
+		static std::filesystem::path causenetPath, landmarkPath;
+		/** @returns the current graph, which stays valid for as long as the returned pointer is held **/
+		static std::shared_ptr<const Snapshot> snapshot() noexcept;
+		/**
+		 * @brief Loads the files in the background and swaps them in for the current snapshot once they are warmed up.
+		 * @returns false if a reload is running already
+		 */
+		static bool reload();
+		/** Configured by `custom_config.response_cache` in the config file; nullptr if disabled **/
+		static std::unique_ptr<ResponseCache> responseCache;
+		/**
+		 * Runs the expensive handlers off drogon's event loops such that they do not delay the cheap requests sharing a
+		 * loop. Configured by `custom_config.workers` in the config file.
+		 */
+		static std::unique_ptr<utils::WorkerPool> workers;
 
 		Controller() noexcept;
 
 		METHOD_LIST_BEGIN
 		ADD_METHOD_TO(Controller::index, "/", drogon::Get);
+		ADD_METHOD_TO(Controller::getCacheStats, "/v1/cache", drogon::Get);
+		ADD_METHOD_TO(Controller::getMetrics, "/metrics", drogon::Get);
+		ADD_METHOD_TO(Controller::postReload, "/admin/reload", drogon::Post);
 		METHOD_LIST_END
 
 		void index(const drogon::HttpRequestPtr& req, DRCallback&& callback);
+		void getCacheStats(const drogon::HttpRequestPtr& req, DRCallback&& callback);
+		void getMetrics(const drogon::HttpRequestPtr& req, DRCallback&& callback);
+		void postReload(const drogon::HttpRequestPtr& req, DRCallback&& callback);
 	};
 
 	class Nodes : public drogon::HttpController<Nodes> {
 		using DRCallback = std::function<void(const drogon::HttpResponsePtr&)>;
 
 	private:
-		causenet::Causenet& causenet;
+		static constexpr size_t defaultPageSize = 1000;
+		static constexpr size_t maxPageSize = 10000;
+
+		/** Caps and defaults of the path search's budget, configured by `custom_config.path_search` **/
+		std::uint32_t maxPathDepth;
+		size_t maxExpandedNodes;
+		std::chrono::milliseconds maxPathTimeout;
+		/**
+		 * Scratch arrays of the searches that run at a time, each about 48 bytes per concept; their number is
+		 * configured by `custom_config.path_search.max_concurrent`
+		 */
+		utils::ObjectPool<utils::PathSearch<std::uint64_t>> pathSearches;
+		/** Used unless the request names a weighting; configured by `custom_config.path_search.weighting` **/
+		causenet::EdgeWeighting defaultWeighting;
+		/** Configured by `custom_config.batch.max_operations` **/
+		size_t maxBatchOperations;
 
 	public:
 		Nodes() noexcept;
@@ -46,7 +128,9 @@ namespace causenet::rest::v1 {
 		ADD_METHOD_TO(Nodes::getNode, "/v1/nodes/{nodeid}", drogon::Get);
 		ADD_METHOD_TO(Nodes::getEffects, "/v1/nodes/{nodeid}/effects", drogon::Get);
 		ADD_METHOD_TO(Nodes::getEffect, "/v1/nodes/{nodeid}/effects/{targetid}", drogon::Get);
+		ADD_METHOD_TO(Nodes::getCauses, "/v1/nodes/{nodeid}/causes", drogon::Get);
 		ADD_METHOD_TO(Nodes::getPath, "/v1/nodes/{nodeid}/path-to/{targetid}", drogon::Get);
+		ADD_METHOD_TO(Nodes::postBatch, "/v1/batch", drogon::Post);
 		METHOD_LIST_END
 
 		void getAllNodes(const drogon::HttpRequestPtr& req, DRCallback&& callback);
@@ -54,8 +138,10 @@ namespace causenet::rest::v1 {
 		void getEffects(const drogon::HttpRequestPtr& req, DRCallback&& callback, std::string nodeid);
 		void
 		getEffect(const drogon::HttpRequestPtr& req, DRCallback&& callback, std::string nodeid, std::string targetid);
-		void
-		getPath(const drogon::HttpRequestPtr& req, DRCallback&& callback, std::string nodeid, std::string targetid);
+		void getCauses(const drogon::HttpRequestPtr& req, DRCallback&& callback, std::string nodeid);
+		drogon::Task<>
+		getPath(drogon::HttpRequestPtr req, DRCallback callback, std::string nodeid, std::string targetid);
+		drogon::Task<> postBatch(drogon::HttpRequestPtr req, DRCallback callback);
 	};
 
 	class ClueWeb12 : public drogon::HttpController<ClueWeb12> {
@@ -63,12 +149,19 @@ namespace causenet::rest::v1 {
 
 	private:
 	public:
+		/** Optional; without it, records are found by decompressing their segment from the start **/
+		static std::unique_ptr<warc::v1::WARCIndex> index;
+		/** Configured by `custom_config.clueweb_dir` in the config file **/
+		static std::filesystem::path partsDir;
+
+		ClueWeb12() noexcept;
+
 		METHOD_LIST_BEGIN
 		ADD_METHOD_TO(ClueWeb12::getEntryContent, "/v1/clueweb/{pageid}/content", drogon::Get);
 		ADD_METHOD_TO(ClueWeb12::getEntryInfo, "/v1/clueweb/{pageid}/info", drogon::Get);
 		METHOD_LIST_END
 
-		void getEntryContent(const drogon::HttpRequestPtr& req, DRCallback&& callback, std::string pageid);
-		void getEntryInfo(const drogon::HttpRequestPtr& req, DRCallback&& callback, std::string pageid);
+		drogon::Task<> getEntryContent(drogon::HttpRequestPtr req, DRCallback callback, std::string pageid);
+		drogon::Task<> getEntryInfo(drogon::HttpRequestPtr req, DRCallback callback, std::string pageid);
 	};
 } // namespace causenet::rest::v1
\ No newline at end of file
@@ -1,11 +1,19 @@
 #ifndef CAUSENET_SUPPORT_HPP
 #define CAUSENET_SUPPORT_HPP
 
+#include <algorithm>
 #include <cinttypes>
+#include <compare>
+#include <cstring>
+#include <iterator>
+#include <optional>
+#include <ranges>
 #include <string>
+#include <string_view>
 
 namespace causenet {
 	enum class SourceType : std::uint8_t { WikipediaInfobox, WikipediaList, WikipediaSentence, ClueWeb12Sentence };
+	static constexpr std::size_t numSourceTypes = 4;
 
 	struct Support {
 		SourceType sourceTypeId;
@@ -16,6 +24,175 @@ namespace causenet {
 			return sourceTypeId == other.sourceTypeId && id == other.id && content == other.content;
 		}
 	};
+
+	/**
+	 * @brief A Support whose strings are not copied out of the Causenet.
+	 * @details If the file stores the sources uncompressed, the strings point into the mapping and stay valid as long
+	 * as the Causenet. Otherwise, they point into a per-thread scratch buffer and are only valid until the same thread
+	 * decodes the next support that lies in other blocks; copy them (e.g., with toSupport()) to keep them longer.
+	 */
+	struct SupportView {
+		SourceType sourceTypeId;
+		std::string_view id;
+		std::string_view content;
+
+		Support toSupport() const { return {sourceTypeId, std::string(id), std::string(content)}; }
+	};
+
+	/** @brief Lengths (without the null terminator) of a support's strings as stored in the SupportLengths section **/
+	struct SupportLength {
+		std::uint32_t id;
+		std::uint32_t content;
+	};
+	static_assert(sizeof(SupportLength) == 8);
+
+	namespace internal {
+		class CompressedSources;
+		/** @returns the `size` uncompressed bytes at `offset` or nullptr (see CompressedSources::read()) **/
+		const char* readSources(const CompressedSources& sources, std::uint64_t offset, std::size_t size);
+	} // namespace internal
+
+	/**
+	 * @brief Random-access range over the supports of an edge that decodes the i-th support on access.
+	 * @details `offsets` points to `count` offsets into the `sourcesSize` bytes of `sources` and `lengths`, if not
+	 * nullptr, to the `count` matching SupportLength entries. Files without stored lengths fall back to `strnlen`. A
+	 * support that does not lie within the sources or whose blocks do not decompress, which only happens in corrupt
+	 * files, decodes as an empty SupportView; the supports are checked here rather than when loading such that they
+	 * stay on demand. If the file stores the sources compressed, `compressed` is set and a view is only valid until the
+	 * same thread decodes a support from different blocks (see SupportView). Collecting the views of a range, e.g.,
+	 * into a vector, therefore needs copies.
+	 */
+	class SupportRange : public std::ranges::view_interface<SupportRange> {
+	private:
+		struct Location {
+			const char* sources = nullptr;
+			std::uint64_t sourcesSize = 0; ///< Uncompressed if compressed
+			const char* offsets = nullptr; ///< Not necessarily aligned in version 1 files
+			const SupportLength* lengths = nullptr;
+			const internal::CompressedSources* compressed = nullptr; ///< Requires lengths
+
+			SupportView decode(std::size_t i) const {
+				std::uint64_t offset;
+				std::memcpy(&offset, offsets + i * sizeof(offset), sizeof(offset));
+				// The type and the terminators of both strings
+				const std::uint64_t size = (lengths != nullptr) ? 3ull + lengths[i].id + lengths[i].content : 3;
+				if (offset > sourcesSize || size > sourcesSize - offset)
+					return {};
+				const char* data = sources + offset;
+				if (compressed != nullptr) {
+					data = internal::readSources(*compressed, offset, size);
+					if (data == nullptr)
+						return {};
+				}
+				SupportView view{.sourceTypeId = static_cast<SourceType>(*data)};
+				data += sizeof(SourceType);
+				if (lengths != nullptr) {
+					view.id = {data, lengths[i].id};
+					view.content = {data + view.id.size() + 1, lengths[i].content};
+					return view;
+				}
+				auto remaining = sourcesSize - offset - sizeof(SourceType);
+				view.id = {data, strnlen(data, remaining)};
+				if (view.id.size() + 1 >= remaining)
+					return {};
+				data += view.id.size() + 1;
+				remaining -= view.id.size() + 1;
+				view.content = {data, strnlen(data, remaining)};
+				return (view.content.size() < remaining) ? view : SupportView{};
+			}
+		};
+
+		Location location;
+		std::size_t count = 0;
+
+		SupportRange(const Location& location, std::size_t count) noexcept : location(location), count(count) {}
+
+	public:
+		/** Only refers to the mapped file such that it outlives the range; see SupportView for its views **/
+		class Iterator {
+		private:
+			Location location;
+			std::ptrdiff_t idx = 0;
+
+		public:
+			using iterator_concept = std::random_access_iterator_tag;
+			using iterator_category = std::input_iterator_tag; ///< operator* returns a prvalue
+			using value_type = SupportView;
+			using difference_type = std::ptrdiff_t;
+
+			Iterator() noexcept = default;
+			Iterator(const Location& location, std::ptrdiff_t idx) noexcept : location(location), idx(idx) {}
+
+			SupportView operator*() const { return location.decode(idx); }
+			SupportView operator[](difference_type n) const { return location.decode(idx + n); }
+
+			Iterator& operator++() noexcept { return ++idx, *this; }
+			Iterator operator++(int) noexcept {
+				auto it = *this;
+				++idx;
+				return it;
+			}
+			Iterator& operator--() noexcept { return --idx, *this; }
+			Iterator operator--(int) noexcept {
+				auto it = *this;
+				--idx;
+				return it;
+			}
+			Iterator& operator+=(difference_type n) noexcept { return idx += n, *this; }
+			Iterator& operator-=(difference_type n) noexcept { return idx -= n, *this; }
+			friend Iterator operator+(Iterator it, difference_type n) noexcept { return it += n; }
+			friend Iterator operator+(difference_type n, Iterator it) noexcept { return it += n; }
+			friend Iterator operator-(Iterator it, difference_type n) noexcept { return it -= n; }
+			friend difference_type operator-(const Iterator& a, const Iterator& b) noexcept { return a.idx - b.idx; }
+
+			bool operator==(const Iterator& other) const noexcept { return idx == other.idx; }
+			auto operator<=>(const Iterator& other) const noexcept { return idx <=> other.idx; }
+		};
+
+		SupportRange() noexcept = default;
+		SupportRange(
+				const char* sources, std::uint64_t sourcesSize, const char* offsets, const SupportLength* lengths,
+				std::size_t count, const internal::CompressedSources* compressed = nullptr
+		) noexcept
+				: location{.sources = sources,
+						   .sourcesSize = sourcesSize,
+						   .offsets = offsets,
+						   .lengths = lengths,
+						   .compressed = compressed},
+				  count(count) {}
+
+		std::size_t size() const noexcept { return count; }
+		/**
+		 * @returns the total length of the ids and contents, taken from the stored lengths without decoding any of
+		 * the supports, or std::nullopt if the file stores no lengths
+		 */
+		std::optional<std::size_t> textSize() const noexcept {
+			if (location.lengths == nullptr)
+				return std::nullopt;
+			std::size_t size = 0;
+			for (std::size_t i = 0; i < count; ++i)
+				size += location.lengths[i].id + location.lengths[i].content;
+			return size;
+		}
+		Iterator begin() const noexcept { return {location, 0}; }
+		Iterator end() const noexcept { return {location, static_cast<std::ptrdiff_t>(count)}; }
+		SupportView operator[](std::size_t i) const { return location.decode(i); }
+
+		/** @returns the (at most) `n` supports starting at `first` without decoding any of them **/
+		SupportRange slice(std::size_t first, std::size_t n) const noexcept {
+			first = std::min(first, count);
+			Location sliced = location;
+			sliced.offsets += first * sizeof(std::uint64_t);
+			if (sliced.lengths != nullptr)
+				sliced.lengths += first;
+			return {sliced, std::min(n, count - first)};
+		}
+	};
+	static_assert(std::ranges::random_access_range<SupportRange>);
+	static_assert(std::ranges::sized_range<SupportRange>);
 } // namespace causenet
 
-#endif
\ No newline at end of file
+template <>
+inline constexpr bool std::ranges::enable_borrowed_range<causenet::SupportRange> = true;
+
+#endif
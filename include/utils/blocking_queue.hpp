@@ -0,0 +1,58 @@
+#ifndef UTILS_BLOCKINGQUEUE_HPP
+#define UTILS_BLOCKINGQUEUE_HPP
+
+#include <condition_variable>
+#include <deque>
+#include <mutex>
+#include <optional>
+
+namespace utils {
+	/**
+	 * @brief Bounded multi-producer multi-consumer FIFO queue.
+	 * @details push() blocks while the queue is full and pop() blocks while it is empty. After close(), push() drops its
+	 * argument and pop() drains the remaining elements before returning std::nullopt.
+	 */
+	template <typename T>
+	class BlockingQueue final {
+	private:
+		std::mutex mutex;
+		std::condition_variable notEmpty;
+		std::condition_variable notFull;
+		std::deque<T> elements;
+		const size_t capacity;
+		bool closed = false;
+
+	public:
+		explicit BlockingQueue(size_t capacity) noexcept : capacity(capacity) {}
+
+		bool push(T element) {
+			std::unique_lock lock(mutex);
+			notFull.wait(lock, [this] { return closed || elements.size() < capacity; });
+			if (closed)
+				return false;
+			elements.emplace_back(std::move(element));
+			notEmpty.notify_one();
+			return true;
+		}
+
+		std::optional<T> pop() {
+			std::unique_lock lock(mutex);
+			notEmpty.wait(lock, [this] { return closed || !elements.empty(); });
+			if (elements.empty())
+				return std::nullopt;
+			T element = std::move(elements.front());
+			elements.pop_front();
+			notFull.notify_one();
+			return element;
+		}
+
+		void close() {
+			std::lock_guard lock(mutex);
+			closed = true;
+			notEmpty.notify_all();
+			notFull.notify_all();
+		}
+	};
+} // namespace utils
+
+#endif
\ No newline at end of file
@@ -0,0 +1,24 @@
+#ifndef UTILS_CSR_HPP
+#define UTILS_CSR_HPP
+
+#include <cinttypes>
+#include <span>
+
+namespace utils {
+	/**
+	 * @brief Non-owning view of a graph in compressed sparse row format.
+	 * @details The neighbors of node `u` are `adj[rows[u]..rows[u+1]]`. If the view was derived from another adjacency
+	 * (e.g., by transposing it), `edgeIds` maps every entry to the index of the same edge in the original one such
+	 * that per-edge data only has to be stored once.
+	 */
+	struct CSRGraph {
+		std::span<const std::uint64_t> rows;
+		std::span<const std::uint32_t> adj;
+		std::span<const std::uint64_t> edgeIds;
+
+		inline std::size_t numNodes() const noexcept { return rows.size() - 1; }
+		inline std::uint64_t edgeId(std::uint64_t i) const noexcept { return edgeIds.empty() ? i : edgeIds[i]; }
+	};
+} // namespace utils
+
+#endif
\ No newline at end of file
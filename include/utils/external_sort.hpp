@@ -0,0 +1,153 @@
+#ifndef UTILS_EXTERNALSORT_HPP
+#define UTILS_EXTERNALSORT_HPP
+
+#include <algorithm>
+#include <cassert>
+#include <filesystem>
+#include <format>
+#include <fstream>
+#include <functional>
+#include <span>
+#include <string>
+#include <type_traits>
+#include <vector>
+
+namespace utils {
+	/**
+	 * @brief Sorts more elements than fit into memory.
+	 * @details The elements are collected in a buffer of at most `memoryLimit` bytes, which is sorted and spilled to a
+	 * run file within `tmpfolder` whenever it is full. merge() then visits all elements in sorted order by a k-way merge
+	 * over the runs, reading each run through a buffer of `memoryLimit / numRuns` bytes. If there are more than
+	 * `maxFanIn` runs, they are first merged in groups into larger runs.
+	 */
+	template <typename T, typename Less = std::less<T>>
+	class ExternalSorter final {
+		static_assert(std::is_trivially_copyable_v<T>);
+
+	private:
+		static constexpr size_t maxFanIn = 128;
+
+		std::filesystem::path tmpfolder;
+		std::string name;
+		size_t bufferCapacity;
+		Less less;
+		std::vector<T> buffer;
+		std::vector<std::filesystem::path> runs;
+		size_t nextRun = 0;
+		size_t count = 0;
+
+		std::filesystem::path newRun() { return tmpfolder / std::format("{}.run{}.tmp", name, nextRun++); }
+
+		void spill() {
+			std::sort(buffer.begin(), buffer.end(), less);
+			auto path = newRun();
+			std::ofstream out(path, std::ios::binary | std::ios::trunc);
+			out.write(reinterpret_cast<const char*>(buffer.data()), buffer.size() * sizeof(T));
+			assert(out);
+			runs.emplace_back(std::move(path));
+			buffer.clear();
+		}
+
+		template <typename F>
+		void mergeRuns(std::span<const std::filesystem::path> group, F&& fn) const {
+			struct Reader {
+				std::ifstream in;
+				std::vector<T> buf;
+				size_t pos = 0, size = 0;
+
+				bool refill() {
+					in.read(reinterpret_cast<char*>(buf.data()), buf.size() * sizeof(T));
+					pos = 0;
+					size = in.gcount() / sizeof(T);
+					return size > 0;
+				}
+			};
+			const size_t readerCapacity = std::max<size_t>(bufferCapacity / group.size(), 1);
+			std::vector<Reader> readers(group.size());
+			std::vector<size_t> heap;
+			for (size_t i = 0; i < group.size(); ++i) {
+				readers[i].in.open(group[i], std::ios::binary);
+				assert(readers[i].in);
+				readers[i].buf.resize(readerCapacity);
+				if (readers[i].refill())
+					heap.push_back(i);
+			}
+			// Ties are broken by the run index such that the order of equal elements is deterministic
+			auto greater = [&](size_t a, size_t b) {
+				const T& x = readers[a].buf[readers[a].pos];
+				const T& y = readers[b].buf[readers[b].pos];
+				return less(y, x) || (!less(x, y) && b < a);
+			};
+			std::make_heap(heap.begin(), heap.end(), greater);
+			while (!heap.empty()) {
+				std::pop_heap(heap.begin(), heap.end(), greater);
+				auto& reader = readers[heap.back()];
+				fn(reader.buf[reader.pos]);
+				if (++reader.pos < reader.size || reader.refill())
+					std::push_heap(heap.begin(), heap.end(), greater);
+				else
+					heap.pop_back();
+			}
+		}
+
+	public:
+		ExternalSorter(std::filesystem::path tmpfolder, std::string name, size_t memoryLimit, Less less = {})
+				: tmpfolder(std::move(tmpfolder)), name(std::move(name)),
+				  bufferCapacity(std::max<size_t>(memoryLimit / sizeof(T), 1024)), less(std::move(less)) {}
+		ExternalSorter(const ExternalSorter&) = delete;
+
+		~ExternalSorter() {
+			std::error_code ec;
+			for (auto& run : runs)
+				std::filesystem::remove(run, ec);
+		}
+
+		void push(const T& element) {
+			if (buffer.capacity() == 0)
+				buffer.reserve(bufferCapacity);
+			buffer.push_back(element);
+			++count;
+			if (buffer.size() == bufferCapacity)
+				spill();
+		}
+
+		size_t size() const noexcept { return count; }
+
+		/** @brief Spills the buffered elements and frees the buffer, e.g., to make room for another sorter **/
+		void release() {
+			if (!buffer.empty())
+				spill();
+			std::vector<T>().swap(buffer);
+		}
+
+		/** @brief Calls `fn(const T&)` for all pushed elements in ascending order **/
+		template <typename F>
+		void merge(F&& fn) {
+			if (runs.empty()) {
+				std::sort(buffer.begin(), buffer.end(), less);
+				for (const auto& element : buffer)
+					fn(element);
+				std::vector<T>().swap(buffer);
+				return;
+			}
+			release();
+			while (runs.size() > maxFanIn) {
+				std::vector<std::filesystem::path> merged;
+				for (size_t i = 0; i < runs.size(); i += maxFanIn) {
+					auto group = std::span(runs).subspan(i, std::min(maxFanIn, runs.size() - i));
+					auto path = newRun();
+					std::ofstream out(path, std::ios::binary | std::ios::trunc);
+					mergeRuns(group, [&](const T& e) { out.write(reinterpret_cast<const char*>(&e), sizeof(T)); });
+					assert(out);
+					for (auto& run : group)
+						std::filesystem::remove(run);
+					merged.emplace_back(std::move(path));
+				}
+				runs = std::move(merged);
+			}
+			mergeRuns(runs, fn);
+		}
+	};
+} // namespace utils
+
+#endif
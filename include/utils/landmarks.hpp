@@ -0,0 +1,192 @@
+#ifndef UTILS_LANDMARKS_HPP
+#define UTILS_LANDMARKS_HPP
+
+#include <algorithm>
+#include <atomic>
+#include <cinttypes>
+#include <functional>
+#include <limits>
+#include <span>
+#include <thread>
+#include <utility>
+#include <vector>
+
+#include "csr.hpp"
+#include "transpose.hpp"
+
+namespace utils {
+	/** Distance to or from a landmark that is not connected to it **/
+	static constexpr std::uint32_t landmarkUnreachable = std::numeric_limits<std::uint32_t>::max();
+	/** Distance to or from a landmark that is at least this long but does not fit into 32 bits **/
+	static constexpr std::uint32_t landmarkSaturated = landmarkUnreachable - 1;
+
+	/**
+	 * @brief Lengths of the shortest paths from `source` to every node of `graph`.
+	 * @details Lengths that do not fit are saturated at `landmarkSaturated`, which LandmarkBounds only uses where an
+	 * underestimate of the length cannot overstate its bound.
+	 * @param weight maps the edge id (see CSRGraph::edgeId) to its non-negative length.
+	 */
+	template <typename WeightFn>
+	inline std::vector<std::uint32_t> distancesFrom(const CSRGraph& graph, std::uint32_t source, WeightFn weight) {
+		static constexpr std::uint64_t saturated = landmarkSaturated;
+		std::vector<std::uint64_t> dist(graph.numNodes(), std::numeric_limits<std::uint64_t>::max());
+		std::vector<std::pair<std::uint64_t, std::uint32_t>> heap = {{0, source}};
+		dist[source] = 0;
+		while (!heap.empty()) {
+			std::pop_heap(heap.begin(), heap.end(), std::greater<>{});
+			const auto [d, node] = heap.back();
+			heap.pop_back();
+			if (dist[node] < d)
+				continue;
+			for (auto i = graph.rows[node]; i < graph.rows[node + 1]; ++i) {
+				const auto neighbor = graph.adj[i];
+				const std::uint64_t nd = d + weight(graph.edgeId(i));
+				if (nd < dist[neighbor]) {
+					dist[neighbor] = nd;
+					heap.emplace_back(nd, neighbor);
+					std::push_heap(heap.begin(), heap.end(), std::greater<>{});
+				}
+			}
+		}
+		std::vector<std::uint32_t> result(dist.size());
+		std::transform(dist.begin(), dist.end(), result.begin(), [](std::uint64_t d) {
+			return (d == std::numeric_limits<std::uint64_t>::max()) ? landmarkUnreachable
+																	: (std::uint32_t)std::min(d, saturated);
+		});
+		return result;
+	}
+
+	enum class LandmarkSelection {
+		Degree,	 ///< The nodes with the most incoming and outgoing edges
+		Farthest ///< Starting at the node of highest degree, the node farthest from all landmarks chosen so far
+	};
+
+	/**
+	 * @brief Landmarks and their distances in node-major order.
+	 * @details `from[v * numLandmarks + l]` is the distance from landmark `l` to `v` and `to[v * numLandmarks + l]` the
+	 * distance from `v` to landmark `l` such that the bounds of a node are computed from two adjacent runs.
+	 */
+	struct Landmarks {
+		std::vector<std::uint32_t> nodes;
+		std::vector<std::uint32_t> from;
+		std::vector<std::uint32_t> to;
+	};
+
+	/**
+	 * @brief Chooses `numLandmarks` landmarks and computes their distances over `forward` and its transpose `backward`.
+	 * @details With LandmarkSelection::Degree, all landmarks are known upfront and their 2 * numLandmarks searches run
+	 * on `numThreads` threads. Farthest-first selection needs the distances of the previous landmarks to choose the
+	 * next one, such that only the forward and backward search of each landmark run in parallel. Its next landmark is
+	 * the node that maximizes the smallest distance to or from any landmark it is connected to; nodes that are not
+	 * connected to any landmark yet are only chosen once no other node is left.
+	 */
+	template <typename WeightFn>
+	inline Landmarks selectLandmarks(
+			const CSRGraph& forward, const CSRGraph& backward, size_t numLandmarks, LandmarkSelection selection,
+			WeightFn weight, unsigned numThreads = std::thread::hardware_concurrency()
+	) {
+		const size_t numNodes = forward.numNodes();
+		numLandmarks = std::min(numLandmarks, numNodes);
+		auto degree = [&](size_t v) {
+			return (forward.rows[v + 1] - forward.rows[v]) + (backward.rows[v + 1] - backward.rows[v]);
+		};
+		Landmarks result;
+		result.from.resize(numNodes * numLandmarks);
+		result.to.resize(numNodes * numLandmarks);
+		auto store = [&](size_t l, bool fwd, const std::vector<std::uint32_t>& dist) {
+			auto& out = fwd ? result.from : result.to;
+			for (size_t v = 0; v < numNodes; ++v)
+				out[v * numLandmarks + l] = dist[v];
+		};
+		auto search = [&](size_t l, bool fwd) {
+			store(l, fwd, distancesFrom(fwd ? forward : backward, result.nodes[l], weight));
+		};
+
+		if (selection == LandmarkSelection::Degree) {
+			std::vector<std::uint32_t> order(numNodes);
+			for (size_t v = 0; v < numNodes; ++v)
+				order[v] = (std::uint32_t)v;
+			std::partial_sort(order.begin(), order.begin() + numLandmarks, order.end(), [&](auto a, auto b) {
+				return degree(a) > degree(b);
+			});
+			result.nodes.assign(order.begin(), order.begin() + numLandmarks);
+			std::atomic<size_t> next = 0;
+			parallelFor(std::clamp<size_t>(numThreads, 1, 2 * numLandmarks), [&](unsigned) {
+				for (size_t task; (task = next++) < 2 * numLandmarks;)
+					search(task / 2, task % 2 == 0);
+			});
+			return result;
+		}
+
+		// Smallest distance of every node to or from the landmarks chosen so far
+		std::vector<std::uint32_t> closest(numNodes, landmarkUnreachable);
+		for (size_t l = 0; l < numLandmarks; ++l) {
+			std::uint32_t next = 0;
+			bool found = false, connected = false;
+			for (size_t v = 0; v < numNodes; ++v) {
+				if (closest[v] == 0 || (l > 0 && degree(v) == 0))
+					continue;
+				const bool isConnected = closest[v] != landmarkUnreachable;
+				// Nodes connected to a landmark are preferred over the others, which are ranked by degree
+				if (!found || (isConnected && (!connected || closest[v] > closest[next])) ||
+					(!isConnected && !connected && degree(v) > degree(next))) {
+					next = (std::uint32_t)v;
+					found = true;
+					connected = isConnected;
+				}
+			}
+			// Only isolated nodes are left
+			while (!found && std::find(result.nodes.begin(), result.nodes.end(), next) != result.nodes.end())
+				++next;
+			result.nodes.push_back(next);
+			parallelFor(2, [&](unsigned t) { search(l, t == 0); });
+			for (size_t v = 0; v < numNodes; ++v) {
+				const auto i = v * numLandmarks + l;
+				closest[v] = std::min({closest[v], result.from[i], result.to[i]});
+			}
+		}
+		return result;
+	}
+
+	/**
+	 * @brief Lower bounds on the distances between nodes derived from the triangle inequality (ALT).
+	 * @details For any landmark `l`, `d(v, t) >= d(l, t) - d(l, v)` and `d(v, t) >= d(v, l) - d(t, l)`. The bound of a
+	 * node is the largest of these over all landmarks. Since each of them is a feasible potential, so is their maximum,
+	 * which makes it an admissible and consistent heuristic for A*. The landmarks also prove unreachability: if `l`
+	 * reaches `v` but not `t`, or `t` reaches `l` but `v` does not, `v` cannot reach `t`.
+	 */
+	struct LandmarkBounds {
+		static constexpr std::uint64_t unreachable = std::numeric_limits<std::uint64_t>::max();
+
+		size_t numLandmarks = 0;
+		std::span<const std::uint32_t> from;
+		std::span<const std::uint32_t> to;
+
+		/** @returns a lower bound on the distance from `v` to `target` or `unreachable` if there is no such path **/
+		inline std::uint64_t lowerBound(std::uint32_t v, std::uint32_t target) const noexcept {
+			const auto fromV = from.subspan(v * numLandmarks, numLandmarks);
+			const auto toV = to.subspan(v * numLandmarks, numLandmarks);
+			const auto fromT = from.subspan(target * numLandmarks, numLandmarks);
+			const auto toT = to.subspan(target * numLandmarks, numLandmarks);
+			std::uint64_t bound = 0;
+			for (size_t l = 0; l < numLandmarks; ++l) {
+				if (fromV[l] != landmarkUnreachable) {
+					if (fromT[l] == landmarkUnreachable)
+						return unreachable;
+					// A saturated distance may be below the true one, so it must not be subtracted
+					if (fromV[l] != landmarkSaturated)
+						bound = std::max<std::uint64_t>(bound, fromT[l] - std::min(fromT[l], fromV[l]));
+				}
+				if (toT[l] != landmarkUnreachable) {
+					if (toV[l] == landmarkUnreachable)
+						return unreachable;
+					if (toT[l] != landmarkSaturated)
+						bound = std::max<std::uint64_t>(bound, toV[l] - std::min(toV[l], toT[l]));
+				}
+			}
+			return bound;
+		}
+	};
+} // namespace utils
+
+#endif
@@ -0,0 +1,99 @@
+#ifndef UTILS_REORDER_HPP
+#define UTILS_REORDER_HPP
+
+#include <algorithm>
+#include <cinttypes>
+#include <numeric>
+#include <string_view>
+#include <utility>
+#include <vector>
+
+#include "csr.hpp"
+
+namespace utils {
+	/** How nodeOrder() numbers the nodes such that the nodes that are traversed together are stored together **/
+	enum class NodeOrdering : std::uint8_t {
+		Input,	///< Keeps the numbering
+		Degree, ///< By descending number of incoming and outgoing edges such that the hubs share few pages
+		Bfs,	///< In breadth-first order, starting each component at its node of highest degree
+		Rcm		///< Reverse Cuthill-McKee: breadth-first from nodes of low degree, visiting neighbors by degree
+	};
+	static constexpr std::size_t numNodeOrderings = 4;
+
+	inline constexpr std::string_view nodeOrderingName(NodeOrdering ordering) noexcept {
+		constexpr std::string_view names[] = {"input", "degree", "bfs", "rcm"};
+		return names[static_cast<std::uint8_t>(ordering)];
+	}
+	/** @returns false if `name` is none of the nodeOrderingName()s **/
+	inline constexpr bool parseNodeOrdering(std::string_view name, NodeOrdering& ordering) noexcept {
+		for (std::uint8_t o = 0; o < numNodeOrderings; ++o) {
+			if (nodeOrderingName(static_cast<NodeOrdering>(o)) == name) {
+				ordering = static_cast<NodeOrdering>(o);
+				return true;
+			}
+		}
+		return false;
+	}
+
+	/**
+	 * @brief Renumbers the nodes of `forward` (with its transpose `backward`) such that neighbors get close numbers.
+	 * @details The breadth-first orderings ignore the direction of the edges since the path searches run both ways.
+	 * Ties are broken by the old number such that the result is deterministic.
+	 * @returns the old number of the node at each new position
+	 */
+	inline std::vector<std::uint32_t>
+	nodeOrder(const CSRGraph& forward, const CSRGraph& backward, NodeOrdering ordering) {
+		const auto numNodes = forward.numNodes();
+		std::vector<std::uint32_t> order(numNodes);
+		std::iota(order.begin(), order.end(), 0);
+		if (ordering == NodeOrdering::Input)
+			return order;
+		auto degree = [&](std::uint32_t node) {
+			return forward.rows[node + 1] - forward.rows[node] + backward.rows[node + 1] - backward.rows[node];
+		};
+		// Degree also fixes the roots of the breadth-first searches: hubs first for Bfs, the periphery first for Rcm
+		std::stable_sort(order.begin(), order.end(), [&](std::uint32_t a, std::uint32_t b) {
+			return (ordering == NodeOrdering::Rcm) ? degree(a) < degree(b) : degree(a) > degree(b);
+		});
+		if (ordering == NodeOrdering::Degree)
+			return order;
+
+		const auto roots = std::move(order);
+		order.clear();
+		order.reserve(numNodes);
+		std::vector<bool> visited(numNodes, false);
+		std::vector<std::uint32_t> neighbors;
+		auto visit = [&](std::uint32_t node) {
+			if (!visited[node]) {
+				visited[node] = true;
+				neighbors.push_back(node);
+			}
+		};
+		for (auto root : roots) {
+			if (visited[root])
+				continue;
+			visited[root] = true;
+			// `order` doubles as the queue of the search
+			order.push_back(root);
+			for (size_t head = order.size() - 1; head < order.size(); ++head) {
+				const auto node = order[head];
+				neighbors.clear();
+				for (auto i = forward.rows[node]; i < forward.rows[node + 1]; ++i)
+					visit(forward.adj[i]);
+				for (auto i = backward.rows[node]; i < backward.rows[node + 1]; ++i)
+					visit(backward.adj[i]);
+				if (ordering == NodeOrdering::Rcm) {
+					std::sort(neighbors.begin(), neighbors.end(), [&](std::uint32_t a, std::uint32_t b) {
+						return std::pair(degree(a), a) < std::pair(degree(b), b);
+					});
+				}
+				order.insert(order.end(), neighbors.begin(), neighbors.end());
+			}
+		}
+		if (ordering == NodeOrdering::Rcm)
+			std::reverse(order.begin(), order.end());
+		return order;
+	}
+} // namespace utils
+
+#endif
@@ -0,0 +1,187 @@
+#ifndef UTILS_SHARDEDCACHE_HPP
+#define UTILS_SHARDEDCACHE_HPP
+
+#include <algorithm>
+#include <bit>
+#include <cinttypes>
+#include <functional>
+#include <list>
+#include <memory>
+#include <mutex>
+#include <optional>
+#include <string>
+#include <string_view>
+#include <unordered_map>
+#include <vector>
+
+namespace utils {
+	/**
+	 * @brief Approximate request counts of a TinyLFU admission policy.
+	 * @details Count-min sketch of four rows of saturating 4-bit counters (stored in a byte each). All counters are
+	 * halved after `10 * width` increments such that the estimates follow recent popularity.
+	 */
+	class FrequencySketch final {
+	private:
+		static constexpr unsigned depth = 4;
+		static constexpr std::uint8_t maxCount = 15;
+		static constexpr std::uint64_t seeds[depth] = {
+				0x9e3779b97f4a7c15ull, 0xbf58476d1ce4e5b9ull, 0x94d049bb133111ebull, 0xd6e8feb86659fd93ull
+		};
+
+		std::vector<std::uint8_t> counters;
+		size_t mask;
+		size_t additions = 0;
+		size_t sampleSize;
+
+		inline size_t slot(std::uint64_t hash, unsigned row) const noexcept {
+			return row * (mask + 1) + (((hash ^ (hash >> 31)) * seeds[row]) >> 32 & mask);
+		}
+
+	public:
+		explicit FrequencySketch(size_t width)
+				: counters(depth * std::bit_ceil(std::max<size_t>(width, 16))), mask(counters.size() / depth - 1),
+				  sampleSize(10 * (mask + 1)) {}
+
+		void increment(std::uint64_t hash) noexcept {
+			for (unsigned row = 0; row < depth; ++row) {
+				auto& counter = counters[slot(hash, row)];
+				counter += (counter < maxCount);
+			}
+			if (++additions == sampleSize) {
+				for (auto& counter : counters)
+					counter >>= 1;
+				additions /= 2;
+			}
+		}
+
+		unsigned estimate(std::uint64_t hash) const noexcept {
+			unsigned count = maxCount;
+			for (unsigned row = 0; row < depth; ++row)
+				count = std::min<unsigned>(count, counters[slot(hash, row)]);
+			return count;
+		}
+	};
+
+	/**
+	 * @brief Thread-safe cache bounded by the total charge of its values with LRU eviction and TinyLFU admission.
+	 * @details The keys are spread over independently locked shards that each get an equal part of the capacity. Each
+	 * shard counts the requests for its keys in a FrequencySketch; a new value that would evict others is only
+	 * admitted if its key was requested more often than that of every entry it evicts. A burst of one-off requests
+	 * therefore does not flush the popular entries.
+	 */
+	template <typename V>
+	class ShardedCache final {
+	public:
+		struct Stats {
+			std::uint64_t hits = 0;
+			std::uint64_t misses = 0;
+			size_t entries = 0;
+			size_t charge = 0;
+		};
+
+	private:
+		struct Entry {
+			std::string key;
+			V value;
+			size_t charge;
+		};
+		struct Shard {
+			std::mutex mutex;
+			std::list<Entry> lru; ///< Most recently used first
+			std::unordered_map<std::string_view, typename std::list<Entry>::iterator> index; ///< Views Entry::key
+			FrequencySketch sketch;
+			size_t charge = 0;
+			std::uint64_t hits = 0, misses = 0;
+
+			explicit Shard(size_t width) : sketch(width) {}
+		};
+
+		const size_t numShards;
+		const size_t shardCapacity;
+		std::unique_ptr<std::unique_ptr<Shard>[]> shards;
+
+		static std::uint64_t hash(std::string_view key) noexcept { return std::hash<std::string_view>()(key); }
+		Shard& shardOf(std::uint64_t hash) const noexcept { return *shards[(hash >> 32) % numShards]; }
+
+		void evict(Shard& shard) {
+			auto& victim = shard.lru.back();
+			shard.charge -= victim.charge;
+			shard.index.erase(victim.key);
+			shard.lru.pop_back();
+		}
+
+	public:
+		/**
+		 * @param capacity the maximum total charge of all values
+		 * @param expectedCharge the typical charge of a value, which determines the size of the frequency sketches
+		 */
+		ShardedCache(size_t capacity, size_t numShards, size_t expectedCharge = 1024)
+				: numShards(std::max<size_t>(numShards, 1)), shardCapacity(capacity / this->numShards),
+				  shards(std::make_unique<std::unique_ptr<Shard>[]>(this->numShards)) {
+			for (size_t i = 0; i < this->numShards; ++i)
+				shards[i] = std::make_unique<Shard>(shardCapacity / std::max<size_t>(expectedCharge, 1));
+		}
+
+		std::optional<V> get(std::string_view key) {
+			const auto h = hash(key);
+			auto& shard = shardOf(h);
+			std::lock_guard lock(shard.mutex);
+			shard.sketch.increment(h);
+			auto it = shard.index.find(key);
+			if (it == shard.index.end()) {
+				++shard.misses;
+				return std::nullopt;
+			}
+			++shard.hits;
+			shard.lru.splice(shard.lru.begin(), shard.lru, it->second);
+			return it->second->value;
+		}
+
+		/** @returns whether the value was admitted **/
+		bool put(std::string key, V value, size_t charge) {
+			if (charge > shardCapacity)
+				return false;
+			const auto h = hash(key);
+			auto& shard = shardOf(h);
+			std::lock_guard lock(shard.mutex);
+			if (auto it = shard.index.find(key); it != shard.index.end()) {
+				shard.charge = shard.charge - it->second->charge + charge;
+				it->second->value = std::move(value);
+				it->second->charge = charge;
+				shard.lru.splice(shard.lru.begin(), shard.lru, it->second);
+			} else {
+				// Decide on all the victims before evicting any such that a rejected value leaves the shard as is
+				const auto frequency = shard.sketch.estimate(h);
+				size_t freed = 0, numVictims = 0;
+				for (auto victim = shard.lru.rbegin(); shard.charge - freed + charge > shardCapacity;
+					 ++victim, ++numVictims) {
+					if (frequency <= shard.sketch.estimate(hash(victim->key)))
+						return false;
+					freed += victim->charge;
+				}
+				for (; numVictims > 0; --numVictims)
+					evict(shard);
+				shard.lru.push_front({std::move(key), std::move(value), charge});
+				shard.index.emplace(shard.lru.front().key, shard.lru.begin());
+				shard.charge += charge;
+			}
+			while (shard.charge > shardCapacity)
+				evict(shard);
+			return true;
+		}
+
+		Stats stats() const {
+			Stats stats;
+			for (size_t i = 0; i < numShards; ++i) {
+				std::lock_guard lock(shards[i]->mutex);
+				stats.hits += shards[i]->hits;
+				stats.misses += shards[i]->misses;
+				stats.entries += shards[i]->lru.size();
+				stats.charge += shards[i]->charge;
+			}
+			return stats;
+		}
+	};
+} // namespace utils
+
+#endif
@@ -2,37 +2,50 @@
 #define UTILS_SHORTESTPATHS_HPP
 
 #include <algorithm>
+#include <array>
 #include <cassert>
+#include <chrono>
+#include <cinttypes>
 #include <concepts>
+#include <functional>
+#include <iostream>
+#include <limits>
 #include <map>
 #include <queue>
 #include <ranges>
 #include <set>
 #include <vector>
 
-#include "generator.hpp"
+#include "csr.hpp"
 
 namespace utils {
 
+	/** Maps a node to a range of its `(neighbor, weight)` pairs, e.g., Causenet::getEffects() **/
 	template <typename T, typename Node>
 	concept NeighborFn = requires(T fn, Node n) {
-		/*requires std::ranges::range<decltype(fn(n))>;*/ // Don't know why but utils::Generator does not fullfill this
-		fn(n);
+		requires std::ranges::input_range<decltype(fn(n))>;
 	};
 
 	template <typename Node, typename F>
 		requires NeighborFn<F, Node>
 	inline std::vector<Node> shortestPath(Node start, Node target, F neighborfn) {
 		using Elem = std::tuple<int, Node>;
+		if (start == target)
+			return {start};
 		std::priority_queue<Elem, std::vector<Elem>, std::greater<Elem>> queue;
 		std::map<Node, Node> previous;
-		std::set<Node> visited;
+		std::map<Node, int> distance = {{start, 0}};
+		std::set<Node> settled;
 		queue.emplace(0, start);
 		for (; !(queue.empty() || std::get<1>(queue.top()) == target); queue.pop()) {
 			const auto [dist, top] = queue.top();
+			// A node may be queued several times; only its first (i.e., shortest) occurrence is expanded
+			if (!settled.insert(top).second)
+				continue;
 			for (auto&& [neighbor, weight] : neighborfn(top)) {
-				const auto& [_, newNode] = visited.insert(neighbor);
-				if (newNode) {
+				auto [it, inserted] = distance.try_emplace(neighbor, dist + weight);
+				if (inserted || dist + weight < it->second) {
+					it->second = dist + weight;
 					queue.emplace(dist + weight, neighbor);
 					previous[neighbor] = top;
 				}
@@ -49,6 +62,293 @@ namespace utils {
 		return {};
 	}
 
+	/** @brief Bounds on the work of a PathSearch; the defaults do not limit it **/
+	struct PathSearchLimits {
+		std::uint32_t maxDepth = std::numeric_limits<std::uint32_t>::max(); ///< Edges of the path
+		size_t maxExpandedNodes = std::numeric_limits<size_t>::max();
+		std::chrono::steady_clock::time_point deadline = std::chrono::steady_clock::time_point::max();
+		/** Polled along with the deadline; the search is abandoned once it returns true **/
+		std::function<bool()> cancelled;
+	};
+
+	struct PathSearchStats {
+		enum class Outcome { Found, Unreachable, DepthExceeded, ExpansionsExceeded, DeadlineExceeded, Cancelled };
+		Outcome outcome = Outcome::Unreachable;
+		size_t expandedNodes = 0; ///< Nodes settled by either side
+		size_t reachedNodes = 0;  ///< Nodes reached, counted once per side
+		std::uint32_t depth = 0;  ///< Largest number of edges from start or target to a settled node
+	};
+
+	/**
+	 * @brief Reusable scratch space for bidirectional Dijkstra and A* on CSRGraph%s.
+	 * @details Distances and parents live in flat arrays indexed by node. Instead of clearing them for every query,
+	 * each entry is stamped with the generation (i.e., query) that wrote it and entries with an older stamp count as
+	 * unreached. Since the arrays are as large as the graph, instances should be reused, e.g. one per thread (see
+	 * threadLocal()) or a bounded number checked out of a utils::ObjectPool.
+	 * @tparam Dist the type of the path lengths.
+	 */
+	template <typename Dist>
+	class PathSearch final {
+	private:
+		static constexpr std::uint32_t none = -1;
+
+		struct Side {
+			std::vector<Dist> dist;
+			std::vector<std::uint32_t> parent;
+			std::vector<std::uint32_t> hops; ///< Edges from the side's origin along the parents
+			std::vector<std::uint32_t> reached; ///< Generation in which dist, parent and hops were last written
+			std::vector<std::uint32_t> settled; ///< Generation in which the node was last settled
+			std::vector<std::pair<Dist, std::uint32_t>> heap;
+		};
+		std::array<Side, 2> sides;
+		std::uint32_t generation = 0;
+		size_t numReached = 0;
+
+		/** Heap pops between two checks of the deadline and the cancellation **/
+		static constexpr size_t pollInterval = 256;
+
+		void prepare(size_t numNodes) {
+			if (sides[0].dist.size() != numNodes || ++generation == 0) {
+				for (auto& side : sides) {
+					side.dist.resize(numNodes);
+					side.parent.resize(numNodes);
+					side.hops.resize(numNodes);
+					side.reached.assign(numNodes, 0);
+					side.settled.assign(numNodes, 0);
+				}
+				generation = 1;
+			}
+			for (auto& side : sides)
+				side.heap.clear();
+			numReached = 0;
+		}
+
+		inline bool isReached(const Side& side, std::uint32_t node) const noexcept {
+			return side.reached[node] == generation;
+		}
+
+		/** @param key orders the heap; the distance unless the search is goal directed **/
+		inline void
+		reach(Side& side, std::uint32_t node, Dist dist, std::uint32_t parent, std::uint32_t hops, Dist key) {
+			numReached += !isReached(side, node);
+			side.dist[node] = dist;
+			side.parent[node] = parent;
+			side.hops[node] = hops;
+			side.reached[node] = generation;
+			side.heap.emplace_back(key, node);
+			std::push_heap(side.heap.begin(), side.heap.end(), std::greater<>{});
+		}
+
+	public:
+		/**
+		 * @brief Computes a shortest path from start to target.
+		 * @details Searches forward from start over `forward` and backward from target over `backward` (the transpose
+		 * of `forward`), always expanding the side with the smaller frontier. Nodes are only settled when they are popped
+		 * with their final distance, such that the result is exact for all non-negative weights.
+		 * @param weight maps the edge id (see CSRGraph::edgeId) to its non-negative length.
+		 * @returns the nodes on the path including start and target or an empty vector if target is unreachable.
+		 */
+		template <typename WeightFn>
+		std::vector<std::uint32_t> shortestPath(
+				const CSRGraph& forward, const CSRGraph& backward, std::uint32_t start, std::uint32_t target,
+				WeightFn weight
+		) {
+			PathSearchStats stats;
+			return shortestPath(forward, backward, start, target, weight, PathSearchLimits{}, stats);
+		}
+
+		/**
+		 * @brief Like shortestPath() above but gives up once it exceeds one of the `limits`.
+		 * @details The search does not follow a side beyond `maxDepth` edges and only accepts paths of at most
+		 * `maxDepth` edges. Such a path is the shortest among those the bounded sides reach, which is the shortest
+		 * path overall unless a shorter one has more edges. If the search was stopped by any other limit, the result
+		 * is empty and `stats.outcome` names the limit.
+		 * @param stats receives the outcome and the work done so far
+		 */
+		template <typename WeightFn>
+		std::vector<std::uint32_t> shortestPath(
+				const CSRGraph& forward, const CSRGraph& backward, std::uint32_t start, std::uint32_t target,
+				WeightFn weight, const PathSearchLimits& limits, PathSearchStats& stats
+		) {
+			using Outcome = PathSearchStats::Outcome;
+			prepare(forward.numNodes());
+			stats = {};
+			if (start == target) {
+				stats.outcome = Outcome::Found;
+				return {start};
+			}
+			reach(sides[0], start, Dist{}, none, 0, Dist{});
+			reach(sides[1], target, Dist{}, none, 0, Dist{});
+			Dist best = std::numeric_limits<Dist>::max();
+			std::uint32_t meet = none;
+			// The meeting node is not settled, so its parents are kept in case it is reached again by a longer path
+			std::array<std::uint32_t, 2> meetParents;
+			bool pruned = false;
+			size_t iterations = 0;
+			auto stop = [&](Outcome outcome) {
+				stats.outcome = outcome;
+				stats.reachedNodes = numReached;
+				return std::vector<std::uint32_t>{};
+			};
+			while (!sides[0].heap.empty() && !sides[1].heap.empty()) {
+				if (sides[0].heap.front().first + sides[1].heap.front().first >= best)
+					break;
+				if (stats.expandedNodes >= limits.maxExpandedNodes)
+					return stop(Outcome::ExpansionsExceeded);
+				if (++iterations % pollInterval == 0) {
+					if (std::chrono::steady_clock::now() >= limits.deadline)
+						return stop(Outcome::DeadlineExceeded);
+					if (limits.cancelled && limits.cancelled())
+						return stop(Outcome::Cancelled);
+				}
+				const bool fwd = sides[0].heap.size() <= sides[1].heap.size();
+				auto& self = sides[fwd ? 0 : 1];
+				const auto& other = sides[fwd ? 1 : 0];
+				const auto& graph = fwd ? forward : backward;
+
+				std::pop_heap(self.heap.begin(), self.heap.end(), std::greater<>{});
+				const auto [dist, node] = self.heap.back();
+				self.heap.pop_back();
+				if (self.settled[node] == generation || self.dist[node] < dist)
+					continue;
+				self.settled[node] = generation;
+				++stats.expandedNodes;
+				const auto hops = self.hops[node] + 1;
+				stats.depth = std::max(stats.depth, hops - 1);
+				if (hops > limits.maxDepth) {
+					pruned |= graph.rows[node] < graph.rows[node + 1];
+					continue;
+				}
+				for (auto i = graph.rows[node]; i < graph.rows[node + 1]; ++i) {
+					const auto neighbor = graph.adj[i];
+					const Dist ndist = dist + weight(graph.edgeId(i));
+					if (!isReached(self, neighbor) || ndist < self.dist[neighbor])
+						reach(self, neighbor, ndist, node, hops, ndist);
+					if (isReached(other, neighbor) && self.dist[neighbor] + other.dist[neighbor] < best) {
+						if (self.hops[neighbor] + other.hops[neighbor] > limits.maxDepth) {
+							pruned = true;
+							continue;
+						}
+						best = self.dist[neighbor] + other.dist[neighbor];
+						meet = neighbor;
+						meetParents = {sides[0].parent[neighbor], sides[1].parent[neighbor]};
+					}
+				}
+			}
+			stats.reachedNodes = numReached;
+			if (meet == none) {
+				stats.outcome = pruned ? Outcome::DepthExceeded : Outcome::Unreachable;
+				return {};
+			}
+			stats.outcome = Outcome::Found;
+			std::vector<std::uint32_t> path = {meet};
+			for (auto node = meetParents[0]; node != none; node = sides[0].parent[node])
+				path.push_back(node);
+			std::reverse(path.begin(), path.end());
+			for (auto node = meetParents[1]; node != none; node = sides[1].parent[node])
+				path.push_back(node);
+			return path;
+		}
+
+		/**
+		 * @brief Computes a shortest path from start to target with A* over `forward`.
+		 * @details `lowerBound(v)` must be a consistent lower bound on the length of the paths from `v` to target
+		 * (e.g., LandmarkBounds::lowerBound()) or the maximum of Dist if there is no such path. Nodes of the latter kind are
+		 * never queued and if it holds for start, the search returns without expanding any node. The bound of each node
+		 * is only computed once per query. The `limits` apply as for the bidirectional search.
+		 */
+		template <typename WeightFn, typename BoundFn>
+		std::vector<std::uint32_t> shortestPathAStar(
+				const CSRGraph& forward, std::uint32_t start, std::uint32_t target, WeightFn weight, BoundFn lowerBound,
+				const PathSearchLimits& limits, PathSearchStats& stats
+		) {
+			using Outcome = PathSearchStats::Outcome;
+			static constexpr Dist noPath = std::numeric_limits<Dist>::max();
+			prepare(forward.numNodes());
+			stats = {};
+			if (start == target) {
+				stats.outcome = Outcome::Found;
+				return {start};
+			}
+			// The second side only caches the bounds; its heap holds the queue keyed by distance plus bound
+			auto& self = sides[0];
+			auto& bounds = sides[1];
+			auto boundOf = [&](std::uint32_t node) {
+				if (!isReached(bounds, node)) {
+					bounds.dist[node] = lowerBound(node);
+					bounds.reached[node] = generation;
+				}
+				return bounds.dist[node];
+			};
+			if (boundOf(start) == noPath) {
+				stats.outcome = Outcome::Unreachable;
+				return {};
+			}
+			reach(self, start, Dist{}, none, 0, boundOf(start));
+			bool pruned = false;
+			size_t iterations = 0;
+			auto stop = [&](Outcome outcome) {
+				stats.outcome = outcome;
+				stats.reachedNodes = numReached;
+				return std::vector<std::uint32_t>{};
+			};
+			while (!self.heap.empty()) {
+				if (stats.expandedNodes >= limits.maxExpandedNodes)
+					return stop(Outcome::ExpansionsExceeded);
+				if (++iterations % pollInterval == 0) {
+					if (std::chrono::steady_clock::now() >= limits.deadline)
+						return stop(Outcome::DeadlineExceeded);
+					if (limits.cancelled && limits.cancelled())
+						return stop(Outcome::Cancelled);
+				}
+				std::pop_heap(self.heap.begin(), self.heap.end(), std::greater<>{});
+				const auto node = self.heap.back().second;
+				self.heap.pop_back();
+				// Since the bound is consistent, the first time a node is popped is with its final distance
+				if (self.settled[node] == generation)
+					continue;
+				self.settled[node] = generation;
+				++stats.expandedNodes;
+				if (node == target)
+					break;
+				const auto dist = self.dist[node];
+				const auto hops = self.hops[node] + 1;
+				stats.depth = std::max(stats.depth, hops - 1);
+				if (hops > limits.maxDepth) {
+					pruned |= forward.rows[node] < forward.rows[node + 1];
+					continue;
+				}
+				for (auto i = forward.rows[node]; i < forward.rows[node + 1]; ++i) {
+					const auto neighbor = forward.adj[i];
+					const Dist ndist = dist + weight(forward.edgeId(i));
+					if (self.settled[neighbor] == generation ||
+						(isReached(self, neighbor) && self.dist[neighbor] <= ndist))
+						continue;
+					const auto bound = boundOf(neighbor);
+					if (bound == noPath)
+						continue;
+					reach(self, neighbor, ndist, node, hops, ndist + bound);
+				}
+			}
+			stats.reachedNodes = numReached;
+			if (self.settled[target] != generation) {
+				stats.outcome = pruned ? Outcome::DepthExceeded : Outcome::Unreachable;
+				return {};
+			}
+			stats.outcome = Outcome::Found;
+			std::vector<std::uint32_t> path;
+			for (auto node = target; node != none; node = self.parent[node])
+				path.push_back(node);
+			std::reverse(path.begin(), path.end());
+			return path;
+		}
+
+		static PathSearch& threadLocal() {
+			thread_local PathSearch instance;
+			return instance;
+		}
+	};
+
 	template <typename F, typename Counter = size_t>
 		requires NeighborFn<F, size_t>
 	inline std::vector<Counter> connectedComponents(size_t numNodes, F neighborFn) {
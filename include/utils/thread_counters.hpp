@@ -0,0 +1,68 @@
+#ifndef UTILS_THREADCOUNTERS_HPP
+#define UTILS_THREADCOUNTERS_HPP
+
+#include <array>
+#include <atomic>
+#include <cinttypes>
+#include <deque>
+#include <mutex>
+#include <vector>
+
+namespace utils {
+	/**
+	 * @brief `N` monotonic counters that every thread adds to within a block of its own.
+	 * @details Since only the owning thread writes a block, add() is a relaxed load and store without a locked
+	 * instruction, and threads never contend for a cache line. snapshot() sums the blocks of all threads that ever
+	 * added, including those that have exited since. A thread registers its block under the mutex on its first add().
+	 */
+	template <size_t N>
+	class ThreadCounters final {
+	private:
+		struct alignas(64) Block {
+			std::array<std::atomic<std::uint64_t>, N> values{};
+		};
+
+		mutable std::mutex mutex;
+		std::deque<Block> blocks; ///< Never moves its elements on emplace_back()
+		const size_t id;
+
+		static size_t nextId() noexcept {
+			static std::atomic<size_t> next = 0;
+			return next.fetch_add(1, std::memory_order_relaxed);
+		}
+
+		Block& local() {
+			// Indexed by the id of the instance, which is never reused such that stale entries are never accessed
+			thread_local std::vector<Block*> local;
+			if (local.size() <= id)
+				local.resize(id + 1, nullptr);
+			if (local[id] == nullptr) {
+				std::lock_guard lock(mutex);
+				local[id] = &blocks.emplace_back();
+			}
+			return *local[id];
+		}
+
+	public:
+		ThreadCounters() : id(nextId()) {}
+		ThreadCounters(const ThreadCounters&) = delete;
+		ThreadCounters& operator=(const ThreadCounters&) = delete;
+
+		void add(size_t counter, std::uint64_t value = 1) {
+			auto& slot = local().values[counter];
+			slot.store(slot.load(std::memory_order_relaxed) + value, std::memory_order_relaxed);
+		}
+
+		/** @returns the sums over all threads; counters that are added to concurrently may be slightly behind **/
+		std::array<std::uint64_t, N> snapshot() const {
+			std::array<std::uint64_t, N> sums{};
+			std::lock_guard lock(mutex);
+			for (const auto& block : blocks)
+				for (size_t i = 0; i < N; ++i)
+					sums[i] += block.values[i].load(std::memory_order_relaxed);
+			return sums;
+		}
+	};
+} // namespace utils
+
+#endif
@@ -0,0 +1,89 @@
+#ifndef UTILS_TRANSPOSE_HPP
+#define UTILS_TRANSPOSE_HPP
+
+#include <algorithm>
+#include <cinttypes>
+#include <span>
+#include <thread>
+#include <utility>
+#include <vector>
+
+namespace utils {
+	template <typename F>
+	inline void parallelFor(unsigned numThreads, F fn) {
+		std::vector<std::jthread> threads;
+		threads.reserve(numThreads);
+		for (unsigned t = 0; t < numThreads; ++t)
+			threads.emplace_back(fn, t);
+	}
+
+	/**
+	 * @brief Transposed compressed sparse row adjacency.
+	 * @details The incoming edges of node `v` are `sources[rows[v]..rows[v+1]]` and `edges` holds the index that each of
+	 * them has within the original (outgoing) adjacency.
+	 */
+	struct TransposedCSR {
+		std::vector<std::uint64_t> rows;
+		std::vector<std::uint32_t> sources;
+		std::vector<std::uint64_t> edges;
+	};
+
+	/**
+	 * @brief Transposes the adjacency `targets[rows[u]..rows[u+1]]` with a parallel counting sort.
+	 * @details Every thread counts the in-degrees of a contiguous range of source nodes into its own histogram. Turning
+	 * these histograms into per-thread write cursors makes the scatter pass free of synchronization and keeps the
+	 * result deterministic: within each row the sources are sorted in ascending order. Since each histogram is as
+	 * large as the graph, the number of threads is capped such that the histograms take no more memory than the
+	 * transposed edges, i.e. sparse graphs are transposed by few threads.
+	 */
+	inline TransposedCSR transpose(
+			std::span<const std::uint64_t> rows, std::span<const std::uint32_t> targets,
+			unsigned numThreads = std::thread::hardware_concurrency()
+	) {
+		const size_t numNodes = rows.size() - 1;
+		// 4 bytes of histogram per node and thread against 12 bytes of sources and edges per edge
+		const size_t maxThreads = std::min<size_t>(numNodes / 4096, 3 * targets.size() / std::max<size_t>(numNodes, 1));
+		numThreads = std::clamp<size_t>(maxThreads, 1, std::max(numThreads, 1u));
+		auto rangeOf = [&](unsigned t) {
+			return std::make_pair(numNodes * t / numThreads, numNodes * (t + 1) / numThreads);
+		};
+
+		std::vector<std::vector<std::uint32_t>> cursors(numThreads);
+		parallelFor(numThreads, [&](unsigned t) {
+			auto [first, last] = rangeOf(t);
+			cursors[t].assign(numNodes, 0);
+			for (size_t e = rows[first]; e < rows[last]; ++e)
+				cursors[t][targets[e]]++;
+		});
+
+		TransposedCSR result;
+		result.rows.resize(numNodes + 1);
+		result.sources.resize(targets.size());
+		result.edges.resize(targets.size());
+		std::uint64_t offset = 0;
+		for (size_t v = 0; v < numNodes; ++v) {
+			result.rows[v] = offset;
+			std::uint32_t inRow = 0;
+			for (auto& cursor : cursors)
+				inRow += std::exchange(cursor[v], inRow);
+			offset += inRow;
+		}
+		result.rows[numNodes] = offset;
+
+		parallelFor(numThreads, [&](unsigned t) {
+			auto [first, last] = rangeOf(t);
+			auto& cursor = cursors[t];
+			for (size_t u = first; u < last; ++u) {
+				for (size_t e = rows[u]; e < rows[u + 1]; ++e) {
+					auto v = targets[e];
+					auto pos = result.rows[v] + cursor[v]++;
+					result.sources[pos] = static_cast<std::uint32_t>(u);
+					result.edges[pos] = e;
+				}
+			}
+		});
+		return result;
+	}
+} // namespace utils
+
+#endif
\ No newline at end of file
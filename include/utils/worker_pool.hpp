@@ -0,0 +1,287 @@
+#ifndef UTILS_WORKERPOOL_HPP
+#define UTILS_WORKERPOOL_HPP
+
+#include <algorithm>
+#include <atomic>
+#include <condition_variable>
+#include <coroutine>
+#include <deque>
+#include <functional>
+#include <limits>
+#include <memory>
+#include <mutex>
+#include <optional>
+#include <thread>
+#include <utility>
+#include <vector>
+
+namespace utils {
+	/**
+	 * @brief Fixed set of threads that run posted tasks, each taking from its own queue first and stealing from the
+	 * others once that is empty.
+	 * @details Tasks posted from outside the pool are spread over the queues round-robin, those posted by a worker go
+	 * to its own queue. A worker runs its own queue LIFO while thieves take the oldest tasks. At most `maxQueued` tasks
+	 * wait at a time; tryPost() rejects any further ones right away such that callers can shed load rather than queue
+	 * without bound. Tasks must not throw. The destructor runs the remaining tasks before it joins the threads.
+	 */
+	class WorkerPool final {
+	public:
+		using Task = std::function<void()>;
+
+	private:
+		struct alignas(64) Queue {
+			std::mutex mutex;
+			std::deque<Task> tasks;
+		};
+
+		const size_t numThreads;
+		const size_t maxQueued;
+		std::unique_ptr<Queue[]> queues;
+		std::vector<std::thread> threads;
+		std::atomic<size_t> numQueued = 0; ///< Includes tasks that are reserved but not pushed yet
+		std::atomic<size_t> nextQueue = 0;
+		std::mutex sleepMutex;
+		std::condition_variable wakeup;
+		bool stopping = false;
+
+		static inline thread_local const WorkerPool* currentPool = nullptr;
+		static inline thread_local size_t currentWorker = 0;
+
+		std::optional<Task> take(size_t self) {
+			{
+				std::lock_guard lock(queues[self].mutex);
+				if (!queues[self].tasks.empty()) {
+					Task task = std::move(queues[self].tasks.back());
+					queues[self].tasks.pop_back();
+					return task;
+				}
+			}
+			for (size_t i = 1; i < numThreads; ++i) {
+				auto& victim = queues[(self + i) % numThreads];
+				std::lock_guard lock(victim.mutex);
+				if (!victim.tasks.empty()) {
+					Task task = std::move(victim.tasks.front());
+					victim.tasks.pop_front();
+					return task;
+				}
+			}
+			return std::nullopt;
+		}
+
+		void run(size_t self) {
+			currentPool = this;
+			currentWorker = self;
+			for (;;) {
+				if (auto task = take(self)) {
+					numQueued.fetch_sub(1, std::memory_order_relaxed);
+					(*task)();
+					continue;
+				}
+				std::unique_lock lock(sleepMutex);
+				// A task may be reserved but not yet pushed, in which case this loops until it is
+				wakeup.wait(lock, [this] { return stopping || numQueued.load(std::memory_order_relaxed) > 0; });
+				if (stopping && numQueued.load(std::memory_order_relaxed) == 0)
+					return;
+			}
+		}
+
+	public:
+		/** Awaitable that continues the awaiting coroutine on a worker; see schedule() **/
+		class ScheduleAwaiter {
+		private:
+			WorkerPool& pool;
+			bool admitted = false;
+
+		public:
+			explicit ScheduleAwaiter(WorkerPool& pool) noexcept : pool(pool) {}
+
+			bool await_ready() const noexcept { return false; }
+			bool await_suspend(std::coroutine_handle<> handle) {
+				// The worker may resume (and finish) the coroutine before tryPost() returns, so this is set first
+				admitted = true;
+				if (pool.tryPost([handle] { handle.resume(); }))
+					return true;
+				admitted = false;
+				return false;
+			}
+			bool await_resume() const noexcept { return admitted; }
+		};
+
+		WorkerPool(size_t numThreads, size_t maxQueued = std::numeric_limits<size_t>::max())
+				: numThreads(std::max<size_t>(numThreads, 1)), maxQueued(maxQueued),
+				  queues(std::make_unique<Queue[]>(this->numThreads)) {
+			for (size_t i = 0; i < this->numThreads; ++i)
+				threads.emplace_back(&WorkerPool::run, this, i);
+		}
+		WorkerPool(const WorkerPool&) = delete;
+		WorkerPool& operator=(const WorkerPool&) = delete;
+		~WorkerPool() {
+			{
+				std::lock_guard lock(sleepMutex);
+				stopping = true;
+			}
+			wakeup.notify_all();
+			for (auto& thread : threads)
+				thread.join();
+		}
+
+		/** @returns false without running `task` if `maxQueued` tasks are already waiting **/
+		bool tryPost(Task task) {
+			for (auto queued = numQueued.load(std::memory_order_relaxed);;) {
+				if (queued >= maxQueued)
+					return false;
+				if (numQueued.compare_exchange_weak(queued, queued + 1, std::memory_order_relaxed))
+					break;
+			}
+			const auto idx = (currentPool == this) ? currentWorker
+												   : nextQueue.fetch_add(1, std::memory_order_relaxed) % numThreads;
+			{
+				std::lock_guard lock(queues[idx].mutex);
+				queues[idx].tasks.push_back(std::move(task));
+			}
+			// A worker that found no task is waiting by the time the lock is free, so it does not miss the notification
+			{ std::lock_guard lock(sleepMutex); }
+			wakeup.notify_one();
+			return true;
+		}
+
+		/**
+		 * @brief `co_await pool.schedule()` continues the coroutine on a worker and yields true.
+		 * @details If the pool rejects it (see tryPost()), the coroutine continues on its thread right away and the
+		 * expression yields false.
+		 */
+		ScheduleAwaiter schedule() noexcept { return ScheduleAwaiter(*this); }
+
+		size_t size() const noexcept { return numThreads; }
+		/** @returns the number of tasks that wait for a worker **/
+		size_t queued() const noexcept { return numQueued.load(std::memory_order_relaxed); }
+	};
+
+	/** @brief Admits at most `limit` concurrent holders of a Permit; acquiring one never blocks **/
+	class ConcurrencyLimit final {
+	private:
+		std::atomic<size_t> current = 0;
+		std::atomic<size_t> limit;
+
+	public:
+		/** @brief Releases its share of the limit on destruction; empty if it was not admitted **/
+		class Permit {
+		private:
+			ConcurrencyLimit* owner = nullptr;
+
+		public:
+			Permit() noexcept = default;
+			explicit Permit(ConcurrencyLimit* owner) noexcept : owner(owner) {}
+			Permit(Permit&& other) noexcept : owner(std::exchange(other.owner, nullptr)) {}
+			Permit& operator=(Permit&& other) noexcept {
+				std::swap(owner, other.owner);
+				return *this;
+			}
+			~Permit() {
+				if (owner != nullptr)
+					owner->current.fetch_sub(1, std::memory_order_relaxed);
+			}
+
+			explicit operator bool() const noexcept { return owner != nullptr; }
+		};
+
+		explicit ConcurrencyLimit(size_t limit = std::numeric_limits<size_t>::max()) noexcept : limit(limit) {}
+
+		void setLimit(size_t limit) noexcept { this->limit.store(limit, std::memory_order_relaxed); }
+
+		Permit tryAcquire() noexcept {
+			if (current.fetch_add(1, std::memory_order_relaxed) >= limit.load(std::memory_order_relaxed)) {
+				current.fetch_sub(1, std::memory_order_relaxed);
+				return {};
+			}
+			return Permit(this);
+		}
+	};
+
+	/**
+	 * @brief Hands out at most `capacity` instances of T at a time, which are created on demand and kept for reuse.
+	 * @details Bounds the number of large scratch objects by the capacity instead of by the threads that ever used
+	 * one. Acquiring never blocks; it yields an empty Lease once all instances are checked out.
+	 */
+	template <typename T>
+	class ObjectPool final {
+	private:
+		std::mutex mutex;
+		std::vector<std::unique_ptr<T>> idle;
+		size_t created = 0; ///< Idle and checked out ones
+		size_t capacity;
+
+		void release(std::unique_ptr<T> object) {
+			std::lock_guard lock(mutex);
+			if (created > capacity) {
+				// The capacity was lowered while the instance was checked out
+				--created;
+				return;
+			}
+			idle.push_back(std::move(object));
+		}
+
+	public:
+		/** @brief Returns its instance to the pool on destruction; empty if none was available **/
+		class Lease {
+		private:
+			ObjectPool* owner = nullptr;
+			std::unique_ptr<T> object;
+
+		public:
+			Lease() noexcept = default;
+			Lease(ObjectPool* owner, std::unique_ptr<T> object) noexcept : owner(owner), object(std::move(object)) {}
+			Lease(Lease&& other) noexcept
+					: owner(std::exchange(other.owner, nullptr)), object(std::move(other.object)) {}
+			Lease& operator=(Lease&& other) noexcept {
+				std::swap(owner, other.owner);
+				std::swap(object, other.object);
+				return *this;
+			}
+			~Lease() {
+				if (object)
+					owner->release(std::move(object));
+			}
+
+			explicit operator bool() const noexcept { return object != nullptr; }
+			T& operator*() const noexcept { return *object; }
+			T* operator->() const noexcept { return object.get(); }
+		};
+
+		explicit ObjectPool(size_t capacity = std::numeric_limits<size_t>::max()) noexcept : capacity(capacity) {}
+		ObjectPool(const ObjectPool&) = delete;
+		ObjectPool& operator=(const ObjectPool&) = delete;
+
+		void setCapacity(size_t capacity) {
+			std::lock_guard lock(mutex);
+			this->capacity = capacity;
+			while (created > capacity && !idle.empty()) {
+				idle.pop_back();
+				--created;
+			}
+		}
+
+		Lease tryAcquire() {
+			{
+				std::lock_guard lock(mutex);
+				if (!idle.empty()) {
+					auto object = std::move(idle.back());
+					idle.pop_back();
+					return Lease(this, std::move(object));
+				}
+				if (created >= capacity)
+					return {};
+				++created;
+			}
+			try {
+				return Lease(this, std::make_unique<T>());
+			} catch (...) {
+				std::lock_guard lock(mutex);
+				--created;
+				throw;
+			}
+		}
+	};
+} // namespace utils
+
+#endif
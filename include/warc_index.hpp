@@ -0,0 +1,156 @@
+#ifndef WARC_INDEX_HPP
+#define WARC_INDEX_HPP
+
+#include "warc.hpp"
+
+#include <cinttypes>
+#include <filesystem>
+#include <memory>
+#include <span>
+#include <string>
+#include <string_view>
+
+namespace warc::v1 {
+	/** "CWIDX001" **/
+	static constexpr std::uint64_t indexMagic = 0x3130305844495743ull;
+	static constexpr std::uint32_t noCheckpoint = -1;
+	static constexpr std::size_t windowSize = 32768;
+
+	struct __attribute__((packed)) IndexHeader {
+		std::uint64_t magic;
+		std::uint64_t numEntries;
+		std::uint64_t numCheckpoints;
+		std::uint64_t checkpointOffset;
+	};
+	static_assert(sizeof(IndexHeader) == 32);
+
+	/**
+	 * @brief Location of a single record.
+	 * @details If `checkpoint == noCheckpoint`, decompression starts at the gzip member beginning at the compressed
+	 * offset `offset`. Otherwise it resumes from the given Checkpoint. In both cases the first `skip` decompressed bytes
+	 * precede the record.
+	 */
+	struct __attribute__((packed)) IndexEntry {
+		char segment[8]; ///< e.g. "0000tw00" for clueweb12-0000tw-00-*
+		std::uint32_t record;
+		std::uint32_t checkpoint;
+		std::uint64_t offset;
+		std::uint64_t skip;
+	};
+	static_assert(sizeof(IndexEntry) == 32);
+
+	/** @brief State needed to resume inflating in the middle of a gzip member (cf. zlib's examples/zran.c) **/
+	struct __attribute__((packed)) Checkpoint {
+		std::uint64_t in;  ///< Compressed offset of the first complete byte after the deflate block boundary
+		std::uint64_t out; ///< Decompressed offset of the block boundary within the file
+		std::uint8_t bits; ///< Number of not yet consumed bits within the byte at `in - 1`
+		std::uint8_t reserved[3];
+		std::uint32_t windowLength;
+		std::uint8_t window[windowSize]; ///< The decompressed bytes preceding `out`
+	};
+	static_assert(sizeof(Checkpoint) == 24 + windowSize);
+
+	/**
+	 * @brief Parses a TREC-ID (e.g., `clueweb12-0000tw-00-00042`) into the segment and record number of `key`.
+	 */
+	bool parseTrecId(std::string_view id, IndexEntry& key) noexcept;
+
+	/**
+	 * @brief Memory mapped index over the records of ClueWeb12 created by buildIndex().
+	 */
+	class WARCIndex final {
+	private:
+		int fd;
+		const char* data;
+		std::size_t size;
+
+		WARCIndex(int fd, const char* data, std::size_t size) noexcept;
+
+	public:
+		WARCIndex(const WARCIndex&) = delete;
+		~WARCIndex();
+
+		/**
+		 * @returns the index or nullptr if the file does not exist, is not an index or its entries or checkpoints
+		 * extend past its end
+		 */
+		static std::unique_ptr<WARCIndex> open(const std::filesystem::path& path);
+
+		const IndexHeader& header() const noexcept { return *reinterpret_cast<const IndexHeader*>(data); }
+		std::span<const IndexEntry> entries() const noexcept;
+		const Checkpoint& checkpoint(std::uint32_t idx) const noexcept;
+
+		/** @returns the entry for the TREC-ID or nullptr if it is not indexed **/
+		const IndexEntry* find(std::string_view trecId) const noexcept;
+
+		/**
+		 * @brief Reads only the record at `entry` from the segment file.
+		 * @returns false if the record could not be read, e.g., because `entry` names a checkpoint that does not exist.
+		 */
+		bool readRecord(const IndexEntry& entry, const std::filesystem::path& segmentFile, WARCRecord& record) const;
+	};
+
+	/**
+	 * @brief Indexes every record within the `*.warc.gz` files below `base`.
+	 * @param span the decompressed distance between two checkpoints within a gzip member. Records that start their own
+	 * gzip member (the common case) do not need any checkpoint.
+	 */
+	void buildIndex(const std::filesystem::path& base, const std::filesystem::path& out, std::size_t span = 1 << 20);
+
+	/** "CWRECMAP" **/
+	static constexpr std::uint64_t recordMapMagic = 0x50414D4345525743ull;
+
+	struct __attribute__((packed)) RecordMapHeader {
+		std::uint64_t magic;
+		std::uint64_t numEntries;
+	};
+	static_assert(sizeof(RecordMapHeader) == 16);
+
+	/** @brief WARC-Record-ID (`<urn:uuid:...>`) packed into the 16 bytes of the UUID and the TREC-ID it belongs to **/
+	struct __attribute__((packed)) RecordMapEntry {
+		std::uint8_t uuid[16];
+		char segment[8];
+		std::uint32_t record;
+	};
+	static_assert(sizeof(RecordMapEntry) == 28);
+
+	/**
+	 * @brief Packs `urn:uuid:xxxxxxxx-xxxx-xxxx-xxxx-xxxxxxxxxxxx` (optionally enclosed in `<>`) into `uuid`.
+	 */
+	bool parseRecordId(std::string_view id, std::uint8_t (&uuid)[16]) noexcept;
+
+	/**
+	 * @brief Memory mapped table from WARC-Record-IDs to TREC-IDs created by buildRecordMap().
+	 * @details The entries are sorted by UUID. Since the UUIDs are random, they are close to uniformly distributed and
+	 * find() starts with an interpolation search, which usually needs only a few probes.
+	 */
+	class RecordMap final {
+	private:
+		int fd;
+		const char* data;
+		std::size_t size;
+
+		RecordMap(int fd, const char* data, std::size_t size) noexcept;
+
+	public:
+		RecordMap(const RecordMap&) = delete;
+		~RecordMap();
+
+		/** @returns the map or nullptr if the file does not exist or is not a valid map **/
+		static std::unique_ptr<RecordMap> open(const std::filesystem::path& path);
+
+		std::span<const RecordMapEntry> entries() const noexcept;
+
+		/** @returns the TREC-ID of the WARC-Record-ID or an empty string if it is unknown **/
+		std::string find(std::string_view recordId) const;
+	};
+
+	/**
+	 * @brief Compiles the text mapping (lines of `<urn:uuid:...>\tclueweb12-...`) into a RecordMap.
+	 * @returns the number of lines that could not be parsed and were skipped.
+	 * @throws std::runtime_error if `in` cannot be read or `out` cannot be written, leaving `out` as it was
+	 */
+	std::size_t buildRecordMap(const std::filesystem::path& in, const std::filesystem::path& out);
+} // namespace warc::v1
+
+#endif
\ No newline at end of file
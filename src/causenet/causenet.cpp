@@ -1,47 +1,75 @@
 #include <causenet/causenet.hpp>
 
+#include "./causenet_external_writer.hpp"
+#include "./compressed_sources.hpp"
 #include "./causenet_writer.hpp"
 
+#include <utils/blocking_queue.hpp>
+#include <utils/reorder.hpp>
+#include <utils/transpose.hpp>
+#include <warc_index.hpp>
+
 #include <rapidjson/document.h>
 #include <rapidjson/stringbuffer.h>
 #include <rapidjson/writer.h>
 
 #include <algorithm>
+#include <array>
+#include <atomic>
+#include <bit>
+#include <cerrno>
+#include <chrono>
+#include <cstring>
+#include <exception>
 #include <format>
 #include <fstream>
 #include <iostream>
 #include <map>
-#include <regex>
+#include <mutex>
 #include <set>
+#include <thread>
 #include <vector>
 
 // Linux only headers :(
 #include <fcntl.h>
 #include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
 
 using causenet::Causenet;
 using causenet::CausenetFile;
+using causenet::CausenetLayout;
+using causenet::EdgeRange;
+using causenet::LoadOptions;
+using causenet::LoadStats;
 using causenet::SourceType;
 using causenet::Support;
+using causenet::SupportLength;
+using causenet::SupportRange;
 namespace json = rapidjson;
 namespace fs = std::filesystem;
 
-//
-std::unordered_map<std::string, std::string> getMap() {
-	std::ifstream file("rec-to-trec-id.txt");
-	assert(file);
-	std::regex rgx("^<(.*)>\\t(.*)$");
-	std::unordered_map<std::string, std::string> ret;
-	std::smatch match;
-	for (std::string line; std::getline(file, line);) {
-		assert(std::regex_search(line, match, rgx));
-		ret[match[1].str()] = match[2].str();
-	}
-	return ret;
+/**
+ * Maps WARC-Record-IDs to ClueWeb12 TREC-IDs using `rec-to-trec-id.bin` from the working directory. If it does not
+ * exist yet, it is compiled from `rec-to-trec-id.txt` once (see causenet_recordmap). Throws, failing the conversion,
+ * if neither can be read.
+ */
+static const warc::v1::RecordMap& recordMap() {
+	static const auto map = [] {
+		static const fs::path binary = "rec-to-trec-id.bin";
+		auto map = warc::v1::RecordMap::open(binary);
+		if (map == nullptr) {
+			warc::v1::buildRecordMap("rec-to-trec-id.txt", binary);
+			map = warc::v1::RecordMap::open(binary);
+		}
+		if (map == nullptr)
+			throw std::runtime_error(std::format("Invalid record map {}", binary.string()));
+		return map;
+	}();
+	return *map;
 }
-std::string warcId2ClueWebId(std::string id) {
-	static auto map = getMap();
-	return map[id];
+std::string warcId2ClueWebId(const std::string& id) {
+	return recordMap().find(id); // Read concurrently by the converter's workers
 }
 //
 
@@ -56,47 +84,600 @@ public:
 	inline const EdgeEntry* getFirstNeighbor(size_t i) const noexcept { return nodes()[i].effects(header); }
 };
 
-static const CausenetFile& mmapFile(int fd, size_t size) {
-	auto filemapped = mmap(nullptr, size, PROT_READ, MAP_SHARED, fd, 0);
+/** Rejects a corrupt or truncated file; loading must not read outside of the mapping, even from a bad file **/
+static void check(bool condition, std::string_view what) {
+	if (!condition)
+		throw std::runtime_error(std::format("Invalid CauseNet file: {}", what));
+}
+
+/** Checks that the node table, the names and every section lie within the `size` bytes of the file **/
+static void checkBounds(const CausenetFile& file, size_t size) {
+	const auto& header = file.header;
+	check(header.conceptOffset <= size && header.infoOffset <= size && header.supportOffset <= size,
+		  "offset beyond the end of the file");
+	check(header.conceptOffset >= sizeof(Header) &&
+				  header.numNodes <= (size - header.conceptOffset) / sizeof(NodeEntry),
+		  "node table beyond the end of the file");
+	if (auto table = header.sections()) {
+		check(table->numSections <=
+					  (header.conceptOffset - sizeof(Header) - sizeof(SectionTable)) / sizeof(SectionEntry),
+			  "section table overlaps the nodes");
+		for (std::uint32_t i = 0; i < table->numSections; ++i) {
+			const auto& entry = table->entries()[i];
+			check(entry.offset <= size && entry.size <= size - entry.offset, "section beyond the end of the file");
+		}
+	}
+	for (size_t i = 0; i < file.numNodes(); ++i)
+		check(file.nodes()[i].nameOffset < size - header.infoOffset, "name beyond the end of the file");
+}
+
+/** Checks that `rows` delimits the `adj` of `numNodes` nodes and that every entry of `adj` is below `bound` **/
+template <typename T>
+static void checkCSR(
+		std::span<const std::uint64_t> rows, std::span<const T> adj, size_t numNodes, size_t bound,
+		std::string_view what
+) {
+	check(rows.size() == numNodes + 1 && rows.front() == 0 && rows.back() == adj.size(), what);
+	check(std::ranges::is_sorted(rows), what);
+	check(std::ranges::all_of(adj, [bound](T x) { return x < bound; }), what);
+}
+
+/**
+ * @brief Resolved views into the mapped sections.
+ * @details Everything that older files do not contain is built once when loading and owned by the `*Storage` members.
+ */
+struct causenet::CausenetLayout {
+	std::uint32_t version;
+	std::span<const nameindex::Slot> nameIndex;
+	std::span<const std::uint64_t> edgeRows;
+	std::span<const std::uint32_t> edgeTargets;
+	std::span<const SupportRef> edgeSupport;
+	const char* supportListBase;
+	const SupportLength* supportLengths = nullptr; ///< Parallel to the offsets at supportListBase if stored
+	std::unique_ptr<internal::CompressedSources> compressedSources;
+	std::uint64_t sourcesSize = 0; ///< Uncompressed
+	std::span<const SupportTypeCounts> supportTypeCounts;
+	std::span<const std::uint64_t> causeRows;
+	std::span<const std::uint32_t> causeSources;
+	std::span<const std::uint64_t> causeEdges; ///< Index of each incoming edge within edgeTargets
+	/** Parallel to edgeTargets for every weighting but EdgeWeighting::Hops, which stays empty **/
+	std::array<std::span<const edgeweights::EdgeWeight>, causenet::numEdgeWeightings> edgeWeights;
+
+	std::vector<nameindex::Slot> nameIndexStorage;
+	std::vector<std::uint64_t> edgeRowStorage;
+	std::vector<std::uint32_t> edgeTargetStorage;
+	std::vector<SupportRef> edgeSupportStorage;
+	std::vector<offset_t> supportListStorage;
+	std::vector<SupportLength> supportLengthStorage;
+	std::vector<SupportTypeCounts> supportTypeCountStorage;
+	utils::TransposedCSR causeStorage;
+	std::array<std::vector<edgeweights::EdgeWeight>, causenet::numEdgeWeightings> edgeWeightStorage;
+	/** Anonymous mapping that holds the topology if it was copied into huge pages (see LoadOptions::hugePages) **/
+	char* hugePageStorage = nullptr;
+	size_t hugePageStorageSize = 0;
+
+	CausenetLayout(const CausenetLayout&) = delete;
+	~CausenetLayout() {
+		if (hugePageStorage != nullptr)
+			munmap(hugePageStorage, hugePageStorageSize);
+	}
+
+	/** Calls `fn` with each span of the topology (see LoadOptions) except for the node table **/
+	template <typename Fn>
+	void forEachTopologySection(Fn&& fn) {
+		fn(nameIndex);
+		fn(edgeRows);
+		fn(edgeTargets);
+		fn(edgeSupport);
+		fn(supportTypeCounts);
+		fn(causeRows);
+		fn(causeSources);
+		fn(causeEdges);
+		for (auto& weights : edgeWeights)
+			fn(weights);
+	}
+
+	/**
+	 * @brief Moves the topology sections within the mapped file into anonymous memory backed by transparent huge pages.
+	 * @returns the number of bytes moved
+	 */
+	size_t copyToHugePages(const char* mapped, size_t mappedSize) {
+		constexpr size_t hugePageSize = 2 << 20;
+		auto inFile = [=](const void* data) { return data >= mapped && data < mapped + mappedSize; };
+		size_t total = 0;
+		forEachTopologySection([&](auto& section) {
+			if (inFile(section.data()))
+				total += (section.size_bytes() + 7) / 8 * 8;
+		});
+		if (total == 0)
+			return 0;
+		// Huge pages need 2 MiB aligned memory, which mmap() does not guarantee; the slack is left unused
+		hugePageStorageSize = (total + hugePageSize - 1) / hugePageSize * hugePageSize + hugePageSize;
+		auto region = mmap(nullptr, hugePageStorageSize, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+		if (region == MAP_FAILED)
+			return 0;
+		hugePageStorage = reinterpret_cast<char*>(region);
+		auto next = reinterpret_cast<char*>(
+				(reinterpret_cast<std::uintptr_t>(hugePageStorage) + hugePageSize - 1) & ~(hugePageSize - 1)
+		);
+		madvise(next, total, MADV_HUGEPAGE);
+		forEachTopologySection([&](auto& section) {
+			using T = typename std::remove_reference_t<decltype(section)>::element_type;
+			if (!inFile(section.data()))
+				return;
+			std::memcpy(next, section.data(), section.size_bytes());
+			section = {reinterpret_cast<T*>(next), section.size()};
+			next += (section.size_bytes() + 7) / 8 * 8;
+		});
+		return total;
+	}
+
+	/** Applies `options` to the sections; see LoadOptions **/
+	void warmUp(const CausenetFile& file, size_t fileSize, const LoadOptions& options, LoadStats& stats) {
+		const auto mapped = reinterpret_cast<const char*>(&file);
+		// Sections that were built in memory or copied into huge pages are resident already
+		auto mappedTopology = [&] {
+			std::vector<std::span<const char>> topology = {
+					{reinterpret_cast<const char*>(file.nodes()), file.numNodes() * sizeof(NodeEntry)}
+			};
+			forEachTopologySection([&](auto& section) {
+				const auto data = reinterpret_cast<const char*>(section.data());
+				if (data >= mapped && data < mapped + fileSize)
+					topology.emplace_back(data, section.size_bytes());
+			});
+			return topology;
+		};
+		auto topology = mappedTopology();
+		for (auto range : topology)
+			stats.topologyBytes += range.size();
+		if (options.hugePages) {
+			stats.hugePageBytes = copyToHugePages(mapped, fileSize);
+			topology = mappedTopology();
+		}
+		static const auto pageSize = static_cast<std::uintptr_t>(sysconf(_SC_PAGESIZE));
+		// madvise() and mlock() want whole pages
+		auto pages = [](std::span<const char> range) {
+			const auto begin = reinterpret_cast<std::uintptr_t>(range.data()) & ~(pageSize - 1);
+			const auto end = (reinterpret_cast<std::uintptr_t>(range.data()) + range.size() + pageSize - 1) &
+							 ~(pageSize - 1);
+			return std::pair(reinterpret_cast<void*>(begin), end - begin);
+		};
+		if (options.advise) {
+			// WILLNEED only reads ahead once, so the topology keeps the default readahead for pages that are evicted
+			// and faulted back in; only the pages between its sections are read at random
+			std::vector<std::pair<std::uintptr_t, std::uintptr_t>> covered;
+			for (auto range : topology) {
+				auto [begin, size] = pages(range);
+				madvise(begin, size, MADV_WILLNEED);
+				const auto first = reinterpret_cast<std::uintptr_t>(begin);
+				covered.emplace_back(first, first + size);
+			}
+			std::ranges::sort(covered);
+			auto adviseRandom = [](std::uintptr_t begin, std::uintptr_t end) {
+				if (begin < end)
+					madvise(reinterpret_cast<void*>(begin), end - begin, MADV_RANDOM);
+			};
+			// The mapping starts at a page boundary
+			auto next = reinterpret_cast<std::uintptr_t>(mapped);
+			for (auto [begin, end] : covered) {
+				adviseRandom(next, begin);
+				next = std::max(next, end);
+			}
+			adviseRandom(next, (reinterpret_cast<std::uintptr_t>(mapped) + fileSize + pageSize - 1) & ~(pageSize - 1));
+		}
+		if (options.prefault) {
+			for (auto range : topology) {
+				const volatile char* data = range.data();
+				for (size_t offset = 0; offset < range.size(); offset += pageSize)
+					(void)data[offset];
+			}
+		}
+		if (options.lock) {
+			if (hugePageStorage != nullptr && mlock(hugePageStorage, hugePageStorageSize) == 0)
+				stats.lockedBytes += stats.hugePageBytes;
+			for (auto range : topology) {
+				auto [begin, size] = pages(range);
+				if (mlock(begin, size) == 0)
+					stats.lockedBytes += range.size();
+			}
+		}
+	}
+
+	/** Copies the support lists into the `*Storage` members, grouping each of them by SourceType **/
+	void groupSupportsByType(const Header& header) {
+		std::vector<SupportRef> refs(edgeSupport.begin(), edgeSupport.end());
+		supportTypeCountStorage.resize(refs.size());
+		std::vector<SourceType> types;
+		for (size_t e = 0; e < refs.size(); ++e) {
+			auto supports = support(header, e);
+			types.clear();
+			for (auto view : supports)
+				types.push_back(view.sourceTypeId);
+			const char* offsets = supportListBase + refs[e].listOffset;
+			const SupportLength* lengths =
+					(supportLengths != nullptr) ? supportLengths + refs[e].listOffset / sizeof(offset_t) : nullptr;
+			refs[e].listOffset = supportListStorage.size() * sizeof(offset_t);
+			for (std::uint8_t type = 0; type < numSourceTypes; ++type) {
+				for (size_t i = 0; i < types.size(); ++i) {
+					if (static_cast<std::uint8_t>(types[i]) != type)
+						continue;
+					offset_t offset;
+					std::memcpy(&offset, offsets + i * sizeof(offset), sizeof(offset));
+					supportListStorage.push_back(offset);
+					if (lengths != nullptr)
+						supportLengthStorage.push_back(lengths[i]);
+					supportTypeCountStorage[e].count[type]++;
+				}
+			}
+		}
+		edgeSupportStorage = std::move(refs);
+		edgeSupport = edgeSupportStorage;
+		supportListBase = reinterpret_cast<const char*>(supportListStorage.data());
+		if (supportLengths != nullptr)
+			supportLengths = supportLengthStorage.data();
+		supportTypeCounts = supportTypeCountStorage;
+	}
+
+	/** @throws std::runtime_error if the file (of `size` bytes, see checkBounds()) is inconsistent **/
+	CausenetLayout(const CausenetFile& file, size_t size) {
+		const auto& header = file.header;
+		auto table = header.sections();
+		version = (table != nullptr) ? table->version : 1;
+		nameIndex = header.section<nameindex::Slot>(SectionId::NameIndex);
+		if (!nameIndex.empty()) {
+			check(std::has_single_bit(nameIndex.size()) && nameIndex.size() > file.numNodes(), "name index");
+			check(std::ranges::all_of(
+						  nameIndex,
+						  [&file](auto slot) {
+							  return slot == nameindex::empty || static_cast<std::uint32_t>(slot) < file.numNodes();
+						  }
+				  ),
+				  "name index");
+		} else {
+			nameIndexStorage = nameindex::build(file.numNodes(), [&file](size_t i) { return file.getCauseName(i); });
+			nameIndex = nameIndexStorage;
+		}
+		// The bytes from supportListBase that the support lists may take up
+		size_t supportListSize = 0;
+		if (version >= 2) {
+			edgeRows = header.section<std::uint64_t>(SectionId::EdgeRows);
+			edgeTargets = header.section<std::uint32_t>(SectionId::EdgeTargets);
+			edgeSupport = header.section<SupportRef>(SectionId::EdgeSupport);
+			supportListBase = header.supportBase();
+			supportListSize = size - header.supportOffset;
+			if (auto lists = header.section<offset_t>(SectionId::SupportLists); !lists.empty()) {
+				supportListBase = reinterpret_cast<const char*>(lists.data());
+				supportListSize = lists.size_bytes();
+				if (auto lengths = header.section<SupportLength>(SectionId::SupportLengths);
+					lengths.size() == lists.size())
+					supportLengths = lengths.data();
+			}
+			compressedSources = internal::CompressedSources::open(header);
+			check(compressedSources == nullptr || supportLengths != nullptr, "compressed sources without lengths");
+		} else {
+			// Version 1 files keep the edges next to the names; gather them into the same layout as version 2
+			edgeRowStorage.reserve(file.numNodes() + 1);
+			edgeRowStorage.push_back(0);
+			const auto end = reinterpret_cast<const char*>(&file) + size;
+			for (size_t i = 0; i < file.numNodes(); ++i) {
+				check(file.nodes()[i].effectOffset <= size - header.infoOffset, "edges beyond the end of the file");
+				for (auto n = file.getFirstNeighbor(i);; ++n) {
+					check(reinterpret_cast<const char*>(n + 1) <= end, "edges beyond the end of the file");
+					if (n->targetIdx == nulledge.targetIdx)
+						break;
+					edgeTargetStorage.push_back(n->targetIdx);
+					edgeSupportStorage.push_back(
+							{.numSupport = n->numSupport, .reserved = 0, .listOffset = n->supportOffset}
+					);
+				}
+				edgeRowStorage.push_back(edgeTargetStorage.size());
+			}
+			edgeRows = edgeRowStorage;
+			edgeTargets = edgeTargetStorage;
+			edgeSupport = edgeSupportStorage;
+			supportListBase = header.nodeInfoBase();
+			supportListSize = size - header.infoOffset;
+		}
+		checkCSR(edgeRows, edgeTargets, file.numNodes(), file.numNodes(), "edges");
+		check(edgeTargets.size() == edgeSupport.size(), "edge support");
+		check(std::ranges::all_of(
+					  edgeSupport,
+					  [supportListSize](const SupportRef& ref) {
+						  return ref.listOffset <= supportListSize &&
+								 ref.numSupport <= (supportListSize - ref.listOffset) / sizeof(offset_t);
+					  }
+			  ),
+			  "support list beyond its section");
+		// The supports themselves are only checked against it when they are decoded (see SupportRange)
+		sourcesSize = (compressedSources != nullptr) ? compressedSources->rawSize() : size - header.supportOffset;
+		supportTypeCounts = header.section<SupportTypeCounts>(SectionId::SupportTypeCounts);
+		if (supportTypeCounts.size() != edgeSupport.size())
+			groupSupportsByType(header);
+		causeRows = header.section<std::uint64_t>(SectionId::CauseRows);
+		causeSources = header.section<std::uint32_t>(SectionId::CauseSources);
+		causeEdges = header.section<std::uint64_t>(SectionId::CauseEdges);
+		if (causeRows.empty()) {
+			causeStorage = utils::transpose(edgeRows, edgeTargets);
+			causeRows = causeStorage.rows;
+			causeSources = causeStorage.sources;
+			causeEdges = causeStorage.edges;
+		}
+		checkCSR(causeRows, causeSources, file.numNodes(), file.numNodes(), "causes");
+		checkCSR(causeRows, causeEdges, file.numNodes(), edgeTargets.size(), "causes");
+		for (auto weighting : edgeweights::stored) {
+			const auto w = static_cast<size_t>(weighting);
+			edgeWeights[w] = header.section<edgeweights::EdgeWeight>(edgeweights::section(weighting));
+			if (edgeWeights[w].size() != edgeTargets.size()) {
+				edgeWeightStorage[w] = edgeweights::compute(edgeRows, supportTypeCounts, weighting);
+				edgeWeights[w] = edgeWeightStorage[w];
+			}
+		}
+	}
+
+	inline std::span<const std::uint32_t> effects(size_t idx) const noexcept {
+		return edgeTargets.subspan(edgeRows[idx], edgeRows[idx + 1] - edgeRows[idx]);
+	}
+	/** @returns the index of the edge idx->target or `(size_t)-1`. Relies on the targets of each row being sorted. **/
+	inline size_t findEdge(size_t idx, size_t target) const noexcept {
+		auto row = effects(idx);
+		auto it = std::lower_bound(row.begin(), row.end(), target);
+		return (it != row.end() && *it == target) ? edgeRows[idx] + std::distance(row.begin(), it) : -1;
+	}
+	inline SupportRange support(const Header& header, size_t edge) const noexcept {
+		return edgeSupport[edge].support(
+				header, sourcesSize, supportListBase, supportLengths, compressedSources.get()
+		);
+	}
+};
+
+static int openFile(const fs::path& path) {
+	int fd = open64(path.c_str(), O_RDONLY);
+	if (fd < 0)
+		throw std::runtime_error(std::format("Cannot open {}: {}", path.string(), std::strerror(errno)));
+	return fd;
+}
+
+/** Taken from the open file such that it matches what is mapped even if the path is replaced meanwhile **/
+static size_t fileSize(int fd) {
+	struct stat64 info;
+	if (fstat64(fd, &info) != 0 || static_cast<size_t>(info.st_size) < sizeof(Header)) {
+		close(fd);
+		throw std::runtime_error("Invalid CauseNet file: shorter than its header");
+	}
+	return info.st_size;
+}
+
+static const CausenetFile& mmapFile(int fd, size_t size, bool populate) {
+	auto filemapped = mmap(nullptr, size, PROT_READ, MAP_SHARED | (populate ? MAP_POPULATE : 0), fd, 0);
+	if (filemapped == MAP_FAILED) {
+		const auto error = errno;
+		close(fd);
+		throw std::runtime_error(std::format("Cannot map CauseNet file: {}", std::strerror(error)));
+	}
 	return *reinterpret_cast<const CausenetFile*>(filemapped);
 }
 
-Causenet::Causenet(const std::filesystem::path& path)
-		: fd(open64(path.c_str(), O_RDONLY)), file(mmapFile(fd, fs::file_size(path))) {}
+/** Unmaps and closes the file if it is rejected since the destructor of the Causenet does not run then **/
+static std::unique_ptr<const CausenetLayout>
+loadLayout(int fd, const CausenetFile& file, size_t size, const LoadOptions& options, LoadStats& stats) {
+	try {
+		checkBounds(file, size);
+		auto layout = std::make_unique<CausenetLayout>(file, size);
+		layout->warmUp(file, size, options, stats);
+		return layout;
+	} catch (...) {
+		munmap(const_cast<CausenetFile*>(&file), size);
+		close(fd);
+		throw;
+	}
+}
 
-size_t Causenet::getConceptIdx(std::string name) const noexcept {
-	for (size_t i = 0; i < file.numNodes(); ++i)
-		if (name == getConceptByIdx(i))
-			return i;
-	return -1;
+Causenet::Causenet(const std::filesystem::path& path, const LoadOptions& options)
+		: fd(openFile(path)), size(fileSize(fd)), file(mmapFile(fd, size, options.populate)),
+		  layout(loadLayout(fd, file, size, options, stats)) {}
+Causenet::Causenet(Causenet&&) noexcept = default;
+Causenet::~Causenet() {
+	if (layout == nullptr)
+		return;
+	layout.reset();
+	munmap(const_cast<CausenetFile*>(&file), size);
+	close(fd);
 }
-const std::string Causenet::getConceptByIdx(size_t idx) const noexcept { return std::string(file.getCauseName(idx)); }
-Generator<std::string> Causenet::getConcepts() const noexcept {
-	for (size_t i = 0; i < file.numNodes(); ++i)
-		co_yield getConceptByIdx(i);
+
+unsigned Causenet::formatVersion() const noexcept { return layout->version; }
+const LoadStats& Causenet::loadStats() const noexcept { return stats; }
+size_t Causenet::getConceptIdx(std::string_view name) const noexcept {
+	return nameindex::lookup(layout->nameIndex, name, [this](size_t i) { return file.getCauseName(i); });
 }
+const std::string Causenet::getConceptByIdx(size_t idx) const noexcept { return std::string(file.getCauseName(idx)); }
+std::string_view Causenet::getConceptName(size_t idx) const noexcept { return file.getCauseName(idx); }
 size_t Causenet::numConcepts() const noexcept { return file.numNodes(); }
-Generator<std::tuple<size_t, unsigned>> Causenet::getEffects(size_t conceptIdx) const noexcept {
-	for (auto n = file.getFirstNeighbor(conceptIdx); n->targetIdx != nulledge.targetIdx; ++n)
-		co_yield {n->targetIdx, n->numSupport};
+EdgeRange Causenet::getEffects(size_t conceptIdx) const noexcept {
+	const auto first = layout->edgeRows[conceptIdx];
+	return {layout->edgeTargets.data() + first, nullptr,
+			reinterpret_cast<const char*>(layout->edgeSupport.data() + first),
+			layout->edgeRows[conceptIdx + 1] - first};
 }
 size_t Causenet::numEffects(size_t conceptIdx) const noexcept {
-	size_t n = 0;
-	for (auto neighbors = file.getFirstNeighbor(conceptIdx); neighbors[n].targetIdx != nulledge.targetIdx; ++n)
-		;
-	return n;
+	return layout->edgeRows[conceptIdx + 1] - layout->edgeRows[conceptIdx];
+}
+EdgeRange Causenet::getCauses(size_t conceptIdx) const noexcept {
+	const auto first = layout->causeRows[conceptIdx];
+	return {layout->causeSources.data() + first, layout->causeEdges.data() + first,
+			reinterpret_cast<const char*>(layout->edgeSupport.data()), layout->causeRows[conceptIdx + 1] - first};
+}
+size_t Causenet::numCauses(size_t conceptIdx) const noexcept {
+	return layout->causeRows[conceptIdx + 1] - layout->causeRows[conceptIdx];
+}
+utils::CSRGraph Causenet::effectGraph() const noexcept {
+	return {.rows = layout->edgeRows, .adj = layout->edgeTargets, .edgeIds = {}};
+}
+utils::CSRGraph Causenet::causeGraph() const noexcept {
+	return {.rows = layout->causeRows, .adj = layout->causeSources, .edgeIds = layout->causeEdges};
+}
+unsigned Causenet::numSupport(size_t edgeId) const noexcept { return layout->edgeSupport[edgeId].numSupport; }
+std::span<const std::uint16_t> Causenet::edgeWeights(causenet::EdgeWeighting weighting) const noexcept {
+	return layout->edgeWeights[static_cast<size_t>(weighting)];
+}
+SupportRange Causenet::getSupportViews(size_t causeIdx, size_t effectIdx) const noexcept {
+	auto edge = layout->findEdge(causeIdx, effectIdx);
+	return (edge != (size_t)-1) ? layout->support(file.header, edge) : SupportRange{};
+}
+SupportRange Causenet::getSupportViews(size_t causeIdx, size_t effectIdx, SourceType type) const noexcept {
+	auto edge = layout->findEdge(causeIdx, effectIdx);
+	if (edge == (size_t)-1)
+		return {};
+	const auto& counts = layout->supportTypeCounts[edge];
+	return layout->support(file.header, edge).slice(counts.first(type), counts[type]);
 }
 std::vector<Support> Causenet::getSupport(size_t causeIdx, size_t effectIdx) const noexcept {
-	for (auto n = file.getFirstNeighbor(causeIdx); n->targetIdx != nulledge.targetIdx; ++n) {
-		if (effectIdx == n->targetIdx) {
-			std::vector<Support> supports;
-			supports.reserve(n->numSupport);
-			for (auto support : n->support(file.header))
-				supports.emplace_back(std::move(support));
-			return supports;
+	auto views = getSupportViews(causeIdx, effectIdx);
+	std::vector<Support> supports;
+	supports.reserve(views.size());
+	for (auto view : views)
+		supports.emplace_back(view.toSupport());
+	return supports;
+}
+
+namespace {
+	struct JsonlEdge {
+		std::string cause;
+		std::string effect;
+		std::vector<Support> supports;
+	};
+	struct JsonlBatch {
+		size_t seq;
+		std::string buffer; ///< Whole lines of the input; parsed in-situ
+		std::vector<JsonlEdge> edges;
+	};
+} // namespace
+
+static bool readChunk(std::istream& in, std::string& chunk, size_t size = 16 << 20) {
+	chunk.resize(size);
+	in.read(chunk.data(), size);
+	chunk.resize(in.gcount());
+	if (chunk.empty())
+		return false;
+	// Complete the last line
+	if (std::string rest; chunk.back() != '\n' && std::getline(in, rest))
+		chunk += rest;
+	return true;
+}
+
+static JsonlEdge parseLine(char* line) {
+	json::Document doc;
+	doc.ParseInsitu(line);
+	auto& data = doc["causal_relation"];
+	JsonlEdge edge{
+			.cause = {data["cause"]["concept"].GetString(), data["cause"]["concept"].GetStringLength()},
+			.effect = {data["effect"]["concept"].GetString(), data["effect"]["concept"].GetStringLength()}
+	};
+	auto& sources = doc["sources"];
+	for (auto it = sources.Begin(); it != sources.End(); ++it) {
+		auto& source = *it;
+		auto& payload = source["payload"];
+		auto sentence = payload.HasMember("sentence") ? payload["sentence"].GetString() : "";
+		Support support{.content = std::move(sentence)};
+		if (source["type"] == "wikipedia_infobox") {
+			support.sourceTypeId = SourceType::WikipediaInfobox;
+			support.id = payload["wikipedia_revision_id"].GetString();
+		} else if (source["type"] == "wikipedia_list") {
+			support.sourceTypeId = SourceType::WikipediaList;
+			support.id = payload["wikipedia_revision_id"].GetString();
+		} else if (source["type"] == "wikipedia_sentence") {
+			support.sourceTypeId = SourceType::WikipediaSentence;
+			support.id = payload["wikipedia_revision_id"].GetString();
+		} else if (source["type"] == "clueweb12_sentence") {
+			support.sourceTypeId = SourceType::ClueWeb12Sentence;
+			support.id = warcId2ClueWebId(payload["clueweb12_page_id"].GetString());
+		} else {
+			throw std::runtime_error(std::format("Invalid source type: {}", source["type"].GetString()));
 		}
+		edge.supports.emplace_back(std::move(support));
 	}
-	return {};
+	return edge;
+}
+
+static void parseBatch(JsonlBatch& batch) {
+	char* line = batch.buffer.data();
+	char* end = line + batch.buffer.size();
+	while (line < end) {
+		char* eol = std::find(line, end, '\n');
+		if (eol != end)
+			*eol = '\0'; // Terminate the line for the in-situ parser
+		if (eol != line)
+			batch.edges.emplace_back(parseLine(line));
+		line = eol + 1;
+	}
+}
+
+/**
+ * @brief Parses the JSONL on `numThreads` workers and hands the edges to `writer` in input order.
+ * @details Stage 1 (reader) splits the input into chunks of whole lines, stage 2 (numThreads workers) parses the chunks
+ * in-situ and stage 3 (this thread) feeds the writer such that the output does not depend on the number of threads.
+ */
+template <typename Writer>
+static void convert(std::ifstream& file, Writer& writer, unsigned numThreads) {
+	numThreads = std::max(numThreads, 1u);
+
+	utils::BlockingQueue<JsonlBatch> todo(2 * numThreads);
+	utils::BlockingQueue<JsonlBatch> parsed(2 * numThreads);
+	std::exception_ptr error;
+	std::mutex errorMutex;
+	std::atomic<bool> failed = false;
+	std::atomic<unsigned> activeWorkers = numThreads;
+	std::vector<std::jthread> workers;
+	for (unsigned t = 0; t < numThreads; ++t) {
+		workers.emplace_back([&] {
+			while (auto batch = todo.pop()) {
+				try {
+					parseBatch(*batch);
+				} catch (...) {
+					std::lock_guard lock(errorMutex);
+					if (!failed.exchange(true))
+						error = std::current_exception();
+				}
+				parsed.push(std::move(*batch));
+			}
+			if (--activeWorkers == 0)
+				parsed.close();
+		});
+	}
+	std::jthread reader([&] {
+		size_t seq = 0;
+		for (std::string chunk; readChunk(file, chunk);)
+			if (!todo.push(JsonlBatch{.seq = seq++, .buffer = std::move(chunk)}))
+				break;
+		todo.close();
+	});
+
+	std::map<size_t, JsonlBatch> outOfOrder;
+	size_t next = 0, numLines = 0;
+	const auto start = std::chrono::steady_clock::now();
+	auto lastReport = start;
+	while (auto batch = parsed.pop()) {
+		if (failed) {
+			todo.close();
+			continue;
+		}
+		outOfOrder.emplace(batch->seq, std::move(*batch));
+		for (auto it = outOfOrder.find(next); it != outOfOrder.end(); it = outOfOrder.find(++next)) {
+			for (auto&& edge : it->second.edges)
+				writer.writeEdge(edge.cause, edge.effect, std::move(edge.supports));
+			numLines += it->second.edges.size();
+			outOfOrder.erase(it);
+		}
+		if (auto now = std::chrono::steady_clock::now(); now - lastReport >= std::chrono::seconds(1)) {
+			lastReport = now;
+			auto seconds = std::chrono::duration<double>(now - start).count();
+			std::cout << "\r" << numLines << " lines (" << (size_t)(numLines / seconds) << " lines/s)   " << std::flush;
+		}
+	}
+	auto seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+	std::cout << "\r" << numLines << " lines in " << seconds << "s (" << (size_t)(numLines / seconds) << " lines/s)"
+			  << std::endl;
+	if (failed)
+		std::rethrow_exception(error);
 }
 
 /**
@@ -105,106 +686,158 @@ std::vector<Support> Causenet::getSupport(size_t causeIdx, size_t effectIdx) con
  * ```
  * +-----------------------+                                          \
  * | uint64_t numNodes     |                                           |  HEADER
+ * | uint64_t conceptOffset|                                           |
+ * | uint64_t infoOffset   |                                           |
+ * | uint64_t supportOffset|                                           |
+ * +-----------------------+                                           |
+ * | uint64_t "CNETSECT"   | SectionTable                              |
+ * | uint32_t version      |                                           |
+ * | uint32_t numSections  |                                           |
+ * +-----------------------+                                           |
+ * | uint32_t id           | SectionEntry[0..numSections-1]            |
+ * | uint32_t reserved     |                                           |
+ * | uint64_t offset       |                                           |
+ * | uint64_t size         |                                           |
  * +-----------------------+                                          /
- * | uint32_t nameOffset   | NodeEntry[0]           -----------+      \
- * | uint32_t effectOffset |                        --------+  |       | NODE LIST
- * +-----------------------+                                |  |       |
- * | uint32_t nameOffset   | NodeEntry[1]                   |  |       |
- * | uint32_t effectOffset |                                |  |       |
- * +-----------------------+                                |  |       .
- *          ...                                             |  |       .
- * +-----------------------+                                |  |       .
- * | uint32_t nameOffset   | NodeEntry[numNodes-1]          |  |       |
- * | uint32_t effectOffset |                                |  |      /
- * +-----------------------+                                |  |      \
- * | Null-terminated name  |                       <--------|--+       | NODE INFO 0
- * | of NodeEntry[0]       |                                |          |
+ * | uint64_t nameOffset   | NodeEntry[0]           --------+         \
+ * | uint64_t 0            |                                |          | NODE LIST
  * +-----------------------+                                |          |
- * | uint32_t targetIdx    | EdgeEntry[0] of NodeEntry[0] <-+          |
- * | uint32_t numSupport   |                                           |
- * | uint32_t supportOffset|                                           |
- * +-----------------------+                                           |
- * | uint32_t targetIdx    | EdgeEntry[1] of NodeEntry[0]              |
- * | uint32_t numSupport   |                                           |
- * | uint32_t supportOffset|                                           |
- * +-----------------------+                                           |
- *          ...                                                        |
- * +-----------------------+                                           |
- * | uint32_t -1           | Nulledge of NodeEntry[0]                  |
- * | uint32_t 0            |                                           |
- * | uint32_t 0            |                                           /
- * +-----------------------+                                           \
- * | Null-terminated name  |                                           | NODE INFO 1
- * | of NodeEntry[1]       |                                           |
- * +-----------------------+                                           |
- * | uint32_t targetIdx    | EdgeEntry[0] of NodeEntry[1]              |
- * | uint32_t numSupport   |                                           |
- * | uint32_t supportOffset|                                           |
+ *          ...                                             |          .
+ * +-----------------------+                                |          .
+ * | uint64_t nameOffset   | NodeEntry[numNodes-1]          |          |
+ * | uint64_t 0            |                                |         /
+ * +-----------------------+                                |         \
+ * | Null-terminated name  |                       <--------+          | NODE INFO
+ * | of NodeEntry[0]       |                                           |
  * +-----------------------+                                           .
  *          ...                                                        .
  * +-----------------------+                                           .
- * | uint32_t -1           | Nulledge of NodeEntry[numNodes-1]         | NODE INFO numNodes-1
- * | uint32_t 0            |                                           |
- * | uint32_t 0            |                                          /
- * +-----------------------+                                          \
- * | byte     typeId       |                                           | SOURCES
+ * | Null-terminated name  |                                           |
+ * | of NodeEntry[N-1]     |                                           |
+ * +-----------------------+                                          /
+ * | byte     typeId       |                                          \  SOURCES
  * | string   id           |                                           |
  * | string   content      |                                           |
  * +-----------------------+                                           .
  *          ...                                                        .
- * +-----------------------+                                           .
- * | byte     typeId       |                                           |
- * | string   id           |                                           |
- * | string   content      |                                           |
+ * +-----------------------+                                          /
+ * | uint64_t slot[cap]    | NameIndex                                \  SECTIONS (each 8-byte aligned)
+ * +-----------------------+                                           |
+ * | uint64_t row[N+1]     | EdgeRows                                  |
+ * +-----------------------+                                           |
+ * | uint32_t target[E]    | EdgeTargets                               |
+ * +-----------------------+                                           |
+ * | SupportRef ref[E]     | EdgeSupport                               |
+ * +-----------------------+                                           |
+ * | uint64_t offset[S]    | SupportLists                              |
+ * +-----------------------+                                           |
+ * | uint64_t row[N+1]     | CauseRows                                 |
+ * +-----------------------+                                           |
+ * | uint32_t source[E]    | CauseSources                              |
+ * +-----------------------+                                           |
+ * | uint64_t edge[E]      | CauseEdges                                |
+ * +-----------------------+                                           |
+ * | SupportLength len[S]  | SupportLengths                            |
+ * +-----------------------+                                           |
+ * | uint32_t count[E][4]  | SupportTypeCounts                         |
+ * +-----------------------+                                           |
+ * | uint16_t length[E]    | EdgeWeightsInverseSupport                 |
+ * +-----------------------+                                           |
+ * | uint16_t length[E]    | EdgeWeightsNegLogConfidence               |
+ * +-----------------------+                                           |
+ * | uint16_t length[E]    | EdgeWeightsSourceTypeWeighted             |
+ * +-----------------------+                                          /
+ * | zstd frames           | SupportBlocks                            \  COMPRESSED SOURCES (optional)
+ * +-----------------------+                                           |
+ * | zstd dictionary       | SupportDictionary                         |
+ * +-----------------------+                                           |
+ * | SupportBlockHeader    | SupportBlockIndex                         |
+ * | uint64_t offset[B+1]  |                                           |
  * +-----------------------+                                          /
  * ```
- * 
+ * The edges of node `i` are `EdgeTargets[EdgeRows[i]..EdgeRows[i+1]]` (sorted by target) and `EdgeSupport` holds the
+ * support metadata of each edge at the same position. A SupportRef points to a run of `numSupport` offsets within
+ * SupportLists, which in turn point into the SOURCES. The NameIndex is an open-addressing hash table over the concept
+ * names (see nameindex). The Cause* sections hold the same edges transposed: the incoming edges of node `i` come from
+ * `CauseSources[CauseRows[i]..CauseRows[i+1]]` (sorted by source) and `CauseEdges` stores where each of them is
+ * located within EdgeTargets such that its support can be found. SupportLengths is parallel to SupportLists and stores
+ * the string lengths of each referenced support such that it can be decoded without scanning for the terminators.
+ * The support list of every edge is grouped by SourceType and SupportTypeCounts stores the size of each group such that
+ * the supports of one type can be paged through without decoding the others. The EdgeWeights* sections are parallel to
+ * EdgeTargets as well and hold the quantized length of every edge under each EdgeWeighting (see edgeweights).
+ * Files with compressed supports leave the SOURCES empty; the support offsets then refer to the uncompressed bytes,
+ * which are split into blocks of equal size that are compressed independently with a shared dictionary.
+ *
+ * Version 1 files (written before the section table existed or with `SectionTable::version == 1`) store the edges
+ * within the NODE INFO instead: behind each name follow the node's EdgeEntry list, terminated by the nulledge, and the
+ * support offsets of these edges (NodeEntry::effectOffset points to the first EdgeEntry). Such files are still
+ * supported; the name index and the edge arrays are then built in memory when loading. The same holds for files that
+ * lack the Cause*, the SupportTypeCounts or the EdgeWeights* sections.
+ *
  * @param inJsonl 
  * @param outBinary 
+ * @param numThreads the number of threads parsing the input. The output is the same for any number of threads.
+ * @param memoryLimit if not 0, the supports and edges are sorted externally within about this many bytes (see
+ * internal::ExternalCausenetWriter) instead of being collected in memory. The output is the same in both cases.
+ * @param compressSupports whether to store the SOURCES compressed (see internal::CompressedSources)
+ * @param ordering how to number the concepts; anything but the input order converts the input twice (see reorder())
  */
-void Causenet::jsonlToBinary(const fs::path& inJsonl, const fs::path& outBinary) {
-	std::ifstream file(inJsonl);
+void Causenet::jsonlToBinary(
+		const fs::path& inJsonl, const fs::path& outBinary, unsigned numThreads, size_t memoryLimit,
+		bool compressSupports, utils::NodeOrdering ordering
+) {
+	if (ordering != utils::NodeOrdering::Input) {
+		// The ordering needs the whole graph, which is only known once it has been converted in input order
+		auto unordered = outBinary;
+		unordered += ".unordered";
+		jsonlToBinary(inJsonl, unordered, numThreads, memoryLimit, false);
+		reorder(unordered, outBinary, ordering, memoryLimit, compressSupports);
+		fs::remove(unordered);
+		return;
+	}
+	std::ifstream file(inJsonl, std::ios::binary);
 	assert(file);
-	const int numRows = 11'609'890; // Yay, hardcoded to print progress
-	int i = 0;
-	internal::CausenetWriter writer(outBinary);
-	for (std::string line; std::getline(file, line);) {
-		json::Document doc;
-		doc.Parse(line.c_str());
-		auto& data = doc["causal_relation"];
-		std::string cause = data["cause"]["concept"].GetString();
-		std::string effect = data["effect"]["concept"].GetString();
-		auto& sources = doc["sources"];
-		std::vector<Support> supports;
-		for (auto it = sources.Begin(); it != sources.End(); ++it) {
-			auto& source = *it;
-			auto& payload = source["payload"];
-			auto sentence = payload.HasMember("sentence") ? payload["sentence"].GetString() : "";
-			Support support{.content = std::move(sentence)};
-			if (source["type"] == "wikipedia_infobox") {
-				support.sourceTypeId = SourceType::WikipediaInfobox;
-				support.id = payload["wikipedia_revision_id"].GetString();
-			} else if (source["type"] == "wikipedia_list") {
-				support.sourceTypeId = SourceType::WikipediaList;
-				support.id = payload["wikipedia_revision_id"].GetString();
-			} else if (source["type"] == "wikipedia_sentence") {
-				support.sourceTypeId = SourceType::WikipediaSentence;
-				support.id = payload["wikipedia_revision_id"].GetString();
-			} else if (source["type"] == "clueweb12_sentence") {
-				support.sourceTypeId = SourceType::ClueWeb12Sentence;
-				support.id = warcId2ClueWebId(payload["clueweb12_page_id"].GetString());
-			} else {
-				throw std::runtime_error(std::format("Invalid source type: {}", source["type"].GetString()));
-			}
-			supports.emplace_back(support);
-		}
-		writer.writeEdge(cause, effect, supports);
-		++i;
-		if (i % 100 == 0)
-			std::cout << "\r" << (i * 100.0f / numRows) << "% \r";
-		//if (i >= 1000000) /** \todo remove */
-		//	break;
+	if (memoryLimit == 0) {
+		internal::CausenetWriter writer(outBinary, compressSupports);
+		convert(file, writer, numThreads);
+	} else {
+		internal::ExternalCausenetWriter writer(outBinary, memoryLimit, compressSupports);
+		convert(file, writer, numThreads);
+	}
+}
+
+/** Hands the concepts and edges of `causenet` to `writer` such that the concept at `order[i]` becomes concept `i` **/
+template <typename Writer>
+static void rewrite(const Causenet& causenet, std::span<const std::uint32_t> order, Writer& writer) {
+	for (auto node : order)
+		writer.writeConcept(std::string(causenet.getConceptName(node)));
+	for (auto node : order) {
+		const std::string cause(causenet.getConceptName(node));
+		for (auto&& [effect, _] : causenet.getEffects(node))
+			writer.writeEdge(cause, std::string(causenet.getConceptName(effect)), causenet.getSupport(node, effect));
+	}
+}
+
+/** The supports are copied edge by edge such that the SOURCES are laid out in the new order as well **/
+void Causenet::reorder(
+		const fs::path& inBinary, const fs::path& outBinary, utils::NodeOrdering ordering, size_t memoryLimit,
+		bool compressSupports
+) {
+	const auto causenet = fromFile(inBinary);
+	const auto order = utils::nodeOrder(causenet.effectGraph(), causenet.causeGraph(), ordering);
+	if (memoryLimit == 0) {
+		internal::CausenetWriter writer(outBinary, compressSupports);
+		rewrite(causenet, order, writer);
+	} else {
+		internal::ExternalCausenetWriter writer(outBinary, memoryLimit, compressSupports);
+		rewrite(causenet, order, writer);
 	}
 }
 
-Causenet Causenet::fromFile(const fs::path& path) { return Causenet(path); }
\ No newline at end of file
+Causenet Causenet::fromFile(const fs::path& path, const LoadOptions& options) {
+	const auto start = std::chrono::steady_clock::now();
+	Causenet causenet(path, options);
+	causenet.stats.duration =
+			std::chrono::duration_cast<std::chrono::milliseconds>(std::chrono::steady_clock::now() - start);
+	return causenet;
+}
\ No newline at end of file
@@ -0,0 +1,336 @@
+#ifndef CAUSENET_CAUSENETEXTERNALWRITER_HPP
+#define CAUSENET_CAUSENETEXTERNALWRITER_HPP
+
+#include "./causenet_file.hpp"
+#include "./causenet_writer.hpp"
+#include <causenet/support.hpp>
+#include <utils/external_sort.hpp>
+
+#include <algorithm>
+#include <cassert>
+#include <filesystem>
+#include <format>
+#include <fstream>
+#include <iostream>
+#include <limits>
+#include <optional>
+#include <string>
+#include <string_view>
+#include <tuple>
+#include <unordered_map>
+#include <utility>
+#include <vector>
+
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <unistd.h>
+
+namespace causenet::internal {
+	/** @brief 128-bit FNV-1a over the serialized support, used in place of the full text to detect duplicates **/
+	struct Fingerprint {
+		std::uint64_t hi, lo;
+
+		static Fingerprint of(const Support& support) noexcept {
+			constexpr auto prime = (unsigned __int128)0x0000000001000000ull << 64 | 0x000000000000013Bull;
+			auto hash = (unsigned __int128)0x6c62272e07bb0142ull << 64 | 0x62b821756295c58dull;
+			auto update = [&](std::string_view bytes) {
+				for (unsigned char c : bytes)
+					hash = (hash ^ c) * prime;
+			};
+			update({reinterpret_cast<const char*>(&support.sourceTypeId), sizeof(support.sourceTypeId)});
+			// The id is null-terminated within the file such that the separator makes the encoding unambiguous
+			update({support.id.c_str(), support.id.length() + 1});
+			update(support.content);
+			return {(std::uint64_t)(hash >> 64), (std::uint64_t)hash};
+		}
+
+		auto operator<=>(const Fingerprint&) const noexcept = default;
+	};
+
+	/**
+	 * @brief Produces the same file as CausenetWriter within a bounded amount of memory.
+	 * @details Instead of keeping the supports and the adjacency in memory until close(), every support occurrence is
+	 * numbered and appended to a raw sources file as is, and the edges are spilled as (cause, effect, support) records
+	 * that order the supports of every edge by SourceType. Duplicate supports are found by externally sorting
+	 * (fingerprint, support number) pairs, the first occurrence of each fingerprint is kept and the final adjacency is
+	 * produced by externally sorting the records (and their transpose for the Cause* sections). Only the concept names
+	 * are kept in memory.
+	 *
+	 * Temporary files are created within `tmpfolder`; their total size is roughly twice the size of the output.
+	 */
+	class ExternalCausenetWriter final {
+	private:
+		static constexpr std::uint64_t noSupport = std::numeric_limits<std::uint64_t>::max();
+		static constexpr unsigned typeShift = 56;
+		static constexpr std::uint64_t numberMask = (std::uint64_t{1} << typeShift) - 1;
+
+		struct FingerprintRecord {
+			Fingerprint fingerprint;
+			std::uint64_t support;
+
+			auto operator<=>(const FingerprintRecord&) const noexcept = default;
+		};
+		struct EdgeRecord {
+			std::uint32_t cause, effect;
+			/** The SourceType in the top byte above the support number; noSupport for an edge without supports **/
+			std::uint64_t support;
+			auto operator<=>(const EdgeRecord&) const noexcept = default;
+		};
+		struct DuplicateRecord {
+			std::uint64_t support, original;
+			auto operator<=>(const DuplicateRecord&) const noexcept = default;
+		};
+		struct SupportSlot {
+			offset_t offset;
+			SupportLength length;
+		};
+		struct CauseRecord {
+			std::uint32_t effect, cause;
+			std::uint64_t edge;
+			auto operator<=>(const CauseRecord&) const noexcept = default;
+		};
+
+		std::filesystem::path outfile;
+		std::filesystem::path tmpfolder;
+		size_t memoryLimit;
+		bool compressSources;
+		bool closed = false;
+
+		std::unordered_map<std::string, std::uint32_t> conceptToIdx;
+		std::vector<std::string_view> names; ///< Keys of conceptToIdx, which stay in place on rehashing
+
+		std::fstream rawSourcesFile;
+		std::uint64_t numSupports = 0;
+		utils::ExternalSorter<FingerprintRecord> fingerprints;
+		utils::ExternalSorter<EdgeRecord> edges;
+
+		std::fstream openTmp(const std::string& name) const {
+			std::fstream file(tmpfolder / name, std::ios::binary | std::ios::trunc | std::ios::in | std::ios::out);
+			assert(file);
+			return file;
+		}
+
+		std::uint32_t intern(const std::string& name) {
+			auto [it, inserted] = conceptToIdx.try_emplace(name, (std::uint32_t)names.size());
+			if (inserted)
+				names.push_back(it->first);
+			return it->second;
+		}
+
+		/**
+		 * @brief Copies the first occurrence of every support from the raw sources to `sourcesFile`.
+		 * @param slots receives the offset within `sourcesFile` and the lengths of each support occurrence
+		 */
+		void deduplicateSupports(std::fstream& sourcesFile, SupportSlot* slots) {
+			utils::ExternalSorter<DuplicateRecord> duplicates(tmpfolder, "duplicates", memoryLimit / 2);
+			Fingerprint current;
+			std::uint64_t original = noSupport;
+			fingerprints.merge([&](const FingerprintRecord& record) {
+				if (original != noSupport && record.fingerprint == current) {
+					duplicates.push({.support = record.support, .original = original});
+				} else {
+					current = record.fingerprint;
+					original = record.support; // The lowest number comes first
+				}
+			});
+			std::cout << "Num Supports: " << numSupports - duplicates.size() << std::endl;
+
+			rawSourcesFile.seekg(0, std::ios::beg);
+			std::uint64_t next = 0;
+			std::string id, content;
+			auto copyUntil = [&](std::uint64_t last) {
+				for (; next < last; ++next) {
+					SourceType type;
+					rawSourcesFile.read(reinterpret_cast<char*>(&type), sizeof(type));
+					std::getline(rawSourcesFile, id, '\0');
+					std::getline(rawSourcesFile, content, '\0');
+					slots[next] = {
+							.offset = (offset_t)sourcesFile.tellp(),
+							.length = {.id = (std::uint32_t)id.length(), .content = (std::uint32_t)content.length()}
+					};
+					sourcesFile.write(reinterpret_cast<const char*>(&type), sizeof(type));
+					sourcesFile.write(id.c_str(), id.length() + 1);
+					sourcesFile.write(content.c_str(), content.length() + 1);
+				}
+			};
+			duplicates.merge([&](const DuplicateRecord& record) {
+				copyUntil(record.support);
+				rawSourcesFile.ignore(sizeof(SourceType));
+				rawSourcesFile.ignore(std::numeric_limits<std::streamsize>::max(), '\0');
+				rawSourcesFile.ignore(std::numeric_limits<std::streamsize>::max(), '\0');
+				slots[next++] = slots[record.original];
+			});
+			copyUntil(numSupports);
+			assert(rawSourcesFile);
+			rawSourcesFile.close();
+			std::filesystem::remove(tmpfolder / "rawsources.tmp");
+		}
+
+		void writeOutfile() {
+			auto nodesFile = openTmp("nodes.tmp");
+			auto nodeInfoFile = openTmp("nodeinfo.tmp");
+			for (auto name : names) {
+				NodeEntry entry{.nameOffset = (offset_t)nodeInfoFile.tellp(), .effectOffset = 0};
+				nodeInfoFile.write(name.data(), name.length());
+				nodeInfoFile.put('\0');
+				nodesFile.write(reinterpret_cast<const char*>(&entry), sizeof(entry));
+			}
+
+			// The final slot of every support occurrence is written to a mapped file such that it does not count
+			// towards the process' memory
+			auto slotsPath = tmpfolder / "supportslots.tmp";
+			int fd = ::open(slotsPath.c_str(), O_RDWR | O_CREAT | O_TRUNC, 0644);
+			assert(fd >= 0);
+			const size_t slotsSize = std::max<size_t>(numSupports * sizeof(SupportSlot), 1);
+			[[maybe_unused]] int err = ::ftruncate(fd, slotsSize);
+			assert(err == 0);
+			auto slots = reinterpret_cast<SupportSlot*>(
+					::mmap(nullptr, slotsSize, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0)
+			);
+			assert(slots != MAP_FAILED);
+			auto sourcesFile = openTmp("sources.tmp");
+			deduplicateSupports(sourcesFile, slots);
+
+			// The sorted edge records are grouped by (cause, effect) into the CSR sections
+			auto edgeRowsFile = openTmp("edgerows.tmp");
+			auto edgeTargetsFile = openTmp("edgetargets.tmp");
+			auto edgeSupportFile = openTmp("edgesupport.tmp");
+			auto supportListsFile = openTmp("supportlists.tmp");
+			auto supportLengthsFile = openTmp("supportlengths.tmp");
+			auto supportTypesFile = openTmp("supporttypes.tmp");
+			std::vector<std::fstream> weightFiles;
+			for (auto weighting : edgeweights::stored)
+				weightFiles.emplace_back(openTmp(std::format("weights-{}.tmp", edgeWeightingName(weighting))));
+			utils::ExternalSorter<CauseRecord> causes(tmpfolder, "causes", memoryLimit / 2);
+			std::uint64_t numEdges = 0;
+			size_t row = 0;
+			auto writeRowsUntil = [&](std::fstream& file, size_t node, std::uint64_t offset) {
+				for (; row <= node; ++row)
+					file.write(reinterpret_cast<const char*>(&offset), sizeof(offset));
+			};
+			std::optional<EdgeRecord> edge;
+			SupportRef ref{};
+			SupportTypeCounts counts{};
+			// The edge lengths only depend on the edges of the same cause, whose counts are kept until the row is done
+			std::vector<SupportTypeCounts> rowCounts;
+			auto flushRow = [&] {
+				const std::uint64_t rows[] = {0, rowCounts.size()};
+				for (size_t w = 0; w < weightFiles.size(); ++w) {
+					auto lengths = edgeweights::compute(rows, rowCounts, edgeweights::stored[w]);
+					weightFiles[w].write(
+							reinterpret_cast<const char*>(lengths.data()), lengths.size() * sizeof(lengths[0])
+					);
+				}
+				rowCounts.clear();
+			};
+			auto flushEdge = [&] {
+				edgeTargetsFile.write(reinterpret_cast<const char*>(&edge->effect), sizeof(edge->effect));
+				edgeSupportFile.write(reinterpret_cast<const char*>(&ref), sizeof(ref));
+				supportTypesFile.write(reinterpret_cast<const char*>(&counts), sizeof(counts));
+				rowCounts.push_back(counts);
+				causes.push({.effect = edge->effect, .cause = edge->cause, .edge = numEdges++});
+			};
+			edges.merge([&](const EdgeRecord& record) {
+				if (!edge || std::tie(record.cause, record.effect) != std::tie(edge->cause, edge->effect)) {
+					if (edge)
+						flushEdge();
+					if (edge && record.cause != edge->cause)
+						flushRow();
+					edge = record;
+					writeRowsUntil(edgeRowsFile, record.cause, numEdges);
+					ref = {.numSupport = 0, .reserved = 0, .listOffset = (offset_t)supportListsFile.tellp()};
+					counts = {};
+				}
+				if (record.support != noSupport) {
+					const auto& slot = slots[record.support & numberMask];
+					supportListsFile.write(reinterpret_cast<const char*>(&slot.offset), sizeof(slot.offset));
+					supportLengthsFile.write(reinterpret_cast<const char*>(&slot.length), sizeof(slot.length));
+					ref.numSupport++;
+					counts.count[record.support >> typeShift]++;
+				}
+			});
+			if (edge)
+				flushEdge();
+			flushRow();
+			writeRowsUntil(edgeRowsFile, names.size(), numEdges);
+			::munmap(slots, slotsSize);
+			::close(fd);
+			std::filesystem::remove(slotsPath);
+
+			auto causeRowsFile = openTmp("causerows.tmp");
+			auto causeSourcesFile = openTmp("causesources.tmp");
+			auto causeEdgesFile = openTmp("causeedges.tmp");
+			row = 0;
+			std::uint64_t numCauses = 0;
+			causes.merge([&](const CauseRecord& record) {
+				writeRowsUntil(causeRowsFile, record.effect, numCauses++);
+				causeSourcesFile.write(reinterpret_cast<const char*>(&record.cause), sizeof(record.cause));
+				causeEdgesFile.write(reinterpret_cast<const char*>(&record.edge), sizeof(record.edge));
+			});
+			writeRowsUntil(causeRowsFile, names.size(), numCauses);
+
+			CausenetFileAssembler out(outfile, names.size(), nodesFile, nodeInfoFile, sourcesFile, compressSources);
+			out.writeSection(
+					SectionId::NameIndex, nameindex::build(names.size(), [this](size_t i) { return names[i]; })
+			);
+			out.writeSection(SectionId::EdgeRows, edgeRowsFile);
+			out.writeSection(SectionId::EdgeTargets, edgeTargetsFile);
+			out.writeSection(SectionId::EdgeSupport, edgeSupportFile);
+			out.writeSection(SectionId::SupportLists, supportListsFile);
+			out.writeSection(SectionId::CauseRows, causeRowsFile);
+			out.writeSection(SectionId::CauseSources, causeSourcesFile);
+			out.writeSection(SectionId::CauseEdges, causeEdgesFile);
+			out.writeSection(SectionId::SupportLengths, supportLengthsFile);
+			out.writeSection(SectionId::SupportTypeCounts, supportTypesFile);
+			for (size_t w = 0; w < weightFiles.size(); ++w)
+				out.writeSection(edgeweights::section(edgeweights::stored[w]), weightFiles[w]);
+			out.finish();
+		}
+
+	public:
+		/**
+		 * @param memoryLimit the number of bytes that may be used for buffering supports and edges (the concept names
+		 * come on top)
+		 */
+		ExternalCausenetWriter(
+				std::filesystem::path outfile, std::filesystem::path tmpfolder, size_t memoryLimit,
+				bool compressSources = false
+		)
+				: outfile(outfile), tmpfolder(tmpfolder), memoryLimit(memoryLimit), compressSources(compressSources),
+				  rawSourcesFile(openTmp("rawsources.tmp")),
+				  fingerprints(tmpfolder, "fingerprints", memoryLimit / 2),
+				  edges(tmpfolder, "edges", memoryLimit / 2) {}
+		ExternalCausenetWriter(std::filesystem::path outfile, size_t memoryLimit, bool compressSources = false)
+				: ExternalCausenetWriter(outfile, outfile.parent_path(), memoryLimit, compressSources) {}
+
+		~ExternalCausenetWriter() { close(); }
+
+		void close() {
+			if (std::exchange(closed, true))
+				return;
+			std::cout << "Num Concepts: " << names.size() << std::endl;
+			edges.release(); // Make room for sorting the fingerprints
+			writeOutfile();
+		}
+
+		/** Numbers the concept unless it is known already; concepts are numbered in the order they are first seen **/
+		void writeConcept(const std::string& name) { intern(name); }
+
+		void writeEdge(const std::string& from, const std::string& to, std::vector<Support> supports) {
+			auto cause = intern(from);
+			auto effect = intern(to);
+			if (supports.empty())
+				edges.push({.cause = cause, .effect = effect, .support = noSupport});
+			for (auto&& support : supports) {
+				rawSourcesFile.put(static_cast<char>(support.sourceTypeId));
+				rawSourcesFile.write(support.id.c_str(), support.id.length() + 1);
+				rawSourcesFile.write(support.content.c_str(), support.content.length() + 1);
+				fingerprints.push({.fingerprint = Fingerprint::of(support), .support = numSupports});
+				const auto type = static_cast<std::uint64_t>(support.sourceTypeId);
+				edges.push({.cause = cause, .effect = effect, .support = type << typeShift | numSupports++});
+			}
+		}
+	};
+} // namespace causenet::internal
+
+#endif
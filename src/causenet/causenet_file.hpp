@@ -1,12 +1,79 @@
 #ifndef CAUSENET_CAUSENETFILE_HPP
 #define CAUSENET_CAUSENETFILE_HPP
 
-#include <utils/generator.hpp>
+#include <causenet/causenet.hpp>
+#include <causenet/support.hpp>
 
+#include <algorithm>
+#include <bit>
 #include <cinttypes>
+#include <cmath>
+#include <cstring>
+#include <limits>
+#include <span>
+#include <string_view>
+#include <vector>
 
 using offset_t = std::uint64_t;
 
+/** "CNETSECT" -- marks that a SectionTable directly follows the Header. */
+static constexpr std::uint64_t sectionMagic = 0x5443455354454E43ull;
+
+/**
+ * Version 1 stores the adjacency as EdgeEntry lists inside the node info blob (see NodeEntry::effects), version 2 only
+ * stores the names there and keeps the adjacency in the EdgeRows, EdgeTargets, EdgeSupport and SupportLists sections.
+ */
+static constexpr std::uint32_t formatVersion = 2;
+
+enum class SectionId : std::uint32_t {
+	NameIndex = 1,
+	EdgeRows,
+	EdgeTargets,
+	EdgeSupport,
+	SupportLists,
+	CauseRows,
+	CauseSources,
+	CauseEdges,
+	SupportLengths,	   ///< Optional; SupportLength of every entry of SupportLists
+	SupportDictionary, ///< Optional, like the next two; zstd dictionary of the compressed SOURCES
+	SupportBlockIndex, ///< SupportBlockHeader and the offsets of the blocks
+	SupportBlocks,	   ///< The compressed SOURCES (see CompressedSources); the SOURCES are empty then
+	SupportTypeCounts, ///< Optional; SupportTypeCounts of every edge
+	/** Optional, like the next two; EdgeWeight of every edge under the respective EdgeWeighting (see edgeweights) **/
+	EdgeWeightsInverseSupport,
+	EdgeWeightsNegLogConfidence,
+	EdgeWeightsSourceTypeWeighted
+};
+
+struct __attribute__((packed)) SectionEntry {
+	SectionId id;
+	std::uint32_t reserved;
+	offset_t offset; ///< Relative to the start of the file
+	offset_t size;	 ///< In bytes
+};
+static_assert(sizeof(SectionEntry) == 24);
+
+/**
+ * @brief Optional table of additional sections.
+ * @details Files written before the table existed have `conceptOffset == sizeof(Header)`. Newer files place the table
+ * (and its entries) between the Header and the node list and move `conceptOffset` behind it such that readers
+ * unaware of the sections can still open the file.
+ */
+struct __attribute__((packed)) SectionTable {
+	std::uint64_t magic;
+	std::uint32_t version;
+	std::uint32_t numSections;
+
+	inline const SectionEntry* entries() const noexcept { return reinterpret_cast<const SectionEntry*>(this + 1); }
+	inline const SectionEntry* find(SectionId id) const noexcept {
+		for (std::uint32_t i = 0; i < numSections; ++i)
+			if (entries()[i].id == id)
+				return &entries()[i];
+		return nullptr;
+	}
+};
+static_assert(sizeof(SectionTable) == 16);
+
 struct __attribute__((packed)) Header {
 	std::size_t numNodes;
 	std::size_t conceptOffset;
@@ -16,36 +83,222 @@ struct __attribute__((packed)) Header {
 	inline const char* nodeBase() const noexcept { return reinterpret_cast<const char*>(this) + conceptOffset; }
 	inline const char* nodeInfoBase() const noexcept { return reinterpret_cast<const char*>(this) + infoOffset; }
 	inline const char* supportBase() const noexcept { return reinterpret_cast<const char*>(this) + supportOffset; }
+
+	inline const SectionTable* sections() const noexcept {
+		if (conceptOffset < sizeof(Header) + sizeof(SectionTable))
+			return nullptr;
+		auto table = reinterpret_cast<const SectionTable*>(this + 1);
+		return (table->magic == sectionMagic) ? table : nullptr;
+	}
+	template <typename T>
+	inline std::span<const T> section(SectionId id) const noexcept {
+		auto table = sections();
+		auto entry = (table != nullptr) ? table->find(id) : nullptr;
+		if (entry == nullptr)
+			return {};
+		return {reinterpret_cast<const T*>(reinterpret_cast<const char*>(this) + entry->offset),
+				entry->size / sizeof(T)};
+	}
 };
 static_assert(sizeof(Header) == 32);
 
+/**
+ * @brief Open-addressing (linear probing) table mapping concept names to node indices.
+ * @details Every slot stores the upper 32 bits of the name's hash next to the node index such that probing only has
+ * to touch the name table on (likely) hits. The hash is persisted and must therefore not change between versions.
+ */
+namespace nameindex {
+	using Slot = std::uint64_t;
+	static constexpr Slot empty = ~Slot{0};
+
+	/** 64-bit FNV-1a */
+	inline constexpr std::uint64_t hash(std::string_view name) noexcept {
+		std::uint64_t h = 0xcbf29ce484222325ull;
+		for (char c : name)
+			h = (h ^ static_cast<unsigned char>(c)) * 0x100000001b3ull;
+		return h;
+	}
+
+	/** Power of two capacity that keeps the load factor at or below 0.75 */
+	inline std::size_t capacity(std::size_t numNodes) noexcept { return std::bit_ceil(numNodes + numNodes / 3 + 1); }
+
+	inline bool equals(const char* stored, std::string_view name) noexcept {
+		return std::memcmp(stored, name.data(), name.size()) == 0 && stored[name.size()] == '\0';
+	}
+
+	template <typename NameFn>
+	inline std::vector<Slot> build(std::size_t numNodes, NameFn nameOf) {
+		std::vector<Slot> slots(capacity(numNodes), empty);
+		const std::size_t mask = slots.size() - 1;
+		for (std::size_t i = 0; i < numNodes; ++i) {
+			auto h = hash(nameOf(i));
+			auto pos = h & mask;
+			while (slots[pos] != empty)
+				pos = (pos + 1) & mask;
+			slots[pos] = ((h >> 32) << 32) | static_cast<std::uint32_t>(i);
+		}
+		return slots;
+	}
+
+	/** @returns the node index or `(size_t)-1` if no node is called `name` */
+	template <typename NameFn>
+	inline std::size_t lookup(std::span<const Slot> slots, std::string_view name, NameFn nameOf) noexcept {
+		if (slots.empty())
+			return -1;
+		const std::size_t mask = slots.size() - 1;
+		const auto h = hash(name);
+		const auto tag = h >> 32;
+		for (auto pos = h & mask; slots[pos] != empty; pos = (pos + 1) & mask) {
+			const auto idx = static_cast<std::uint32_t>(slots[pos]);
+			if ((slots[pos] >> 32) == tag && equals(nameOf(idx), name))
+				return idx;
+		}
+		return -1;
+	}
+} // namespace nameindex
+
+/** Version 1 edge. Lives in the node info blob and is terminated by the nulledge. */
 struct __attribute__((packed)) EdgeEntry {
 	uint32_t targetIdx;
 	uint32_t numSupport;
 	offset_t supportOffset;
 
-	inline Generator<causenet::Support> support(const Header& file) const {
-		const offset_t* base = reinterpret_cast<const offset_t*>(file.nodeInfoBase() + supportOffset);
-		causenet::Support support;
-		for (size_t i = 0; i < numSupport; ++i) {
-			const char* data = file.supportBase() + base[i];
-			support.sourceTypeId = *reinterpret_cast<const causenet::SourceType*>(data);
-			data += sizeof(support.sourceTypeId);
-			support.id = std::string(data);
-			data += support.id.length() + 1;
-			support.content = std::string(data);
-			data += support.content.length() + 1;
-			co_yield std::move(support);
-		}
+	/** @param sourcesSize the bytes from Header::supportBase() to the end of the file **/
+	inline causenet::SupportRange support(const Header& file, std::uint64_t sourcesSize) const {
+		return {file.supportBase(), sourcesSize, file.nodeInfoBase() + supportOffset, nullptr, numSupport};
 	}
 };
 static_assert(sizeof(EdgeEntry) == 16);
 
+/**
+ * @brief Support metadata of a version 2 edge; parallel to the EdgeTargets section.
+ * @details `listOffset` is relative to the SupportLists section and points to `numSupport` offsets into the sources.
+ */
+struct __attribute__((packed)) SupportRef {
+	uint32_t numSupport;
+	uint32_t reserved;
+	offset_t listOffset;
+
+	/**
+	 * @param sourcesSize the (uncompressed) size of the SOURCES
+	 * @param lengths the SupportLengths section or nullptr if the file has none
+	 * @param compressed the compressed SOURCES or nullptr if they are stored as is
+	 */
+	inline causenet::SupportRange support(
+			const Header& file, std::uint64_t sourcesSize, const char* listBase, const causenet::SupportLength* lengths,
+			const causenet::internal::CompressedSources* compressed = nullptr
+	) const {
+		return {file.supportBase(), sourcesSize, listBase + listOffset,
+				(lengths != nullptr) ? lengths + listOffset / sizeof(offset_t) : nullptr, numSupport, compressed};
+	}
+};
+static_assert(sizeof(SupportRef) == 16);
+static_assert(sizeof(SupportRef) == causenet::EdgeRange::supportStride);
+
+/**
+ * @brief Number of supports per SourceType of a version 2 edge; parallel to the EdgeTargets section.
+ * @details Files with this section store the support list of every edge grouped by SourceType (in the order of the
+ * enum, each group in the order of the input) such that the supports of one type are a contiguous run of it.
+ */
+struct __attribute__((packed)) SupportTypeCounts {
+	uint32_t count[causenet::numSourceTypes];
+
+	inline uint32_t operator[](causenet::SourceType type) const noexcept {
+		return count[static_cast<std::uint8_t>(type)];
+	}
+	/** @returns the position of the first support of the given type within the edge's support list **/
+	inline uint32_t first(causenet::SourceType type) const noexcept {
+		uint32_t first = 0;
+		for (std::uint8_t t = 0; t < static_cast<std::uint8_t>(type); ++t)
+			first += count[t];
+		return first;
+	}
+};
+static_assert(sizeof(SupportTypeCounts) == 16);
+
+/**
+ * @brief Lengths of the edges for the path searches, quantized to 16 bits (see causenet::EdgeWeighting).
+ * @details Every stored weighting has its own section parallel to EdgeTargets such that a search only reads the lengths
+ * it needs, in the order of the edges. All lengths are at least 1 such that, among equally long paths, the search
+ * still prefers those with fewer edges.
+ */
+namespace edgeweights {
+	using EdgeWeight = std::uint16_t;
+
+	/** The length of an edge with a single support under InverseSupport and SourceTypeWeighted **/
+	static constexpr double supportScale = 4096;
+	/** Fixed-point scale of `-log(p)` under NegLogConfidence **/
+	static constexpr double logScale = 1024;
+	/** How much a support of each SourceType counts under SourceTypeWeighted; curated sources count more **/
+	static constexpr double typeWeights[causenet::numSourceTypes] = {4, 3, 2, 1};
+
+	inline constexpr SectionId section(causenet::EdgeWeighting weighting) noexcept {
+		switch (weighting) {
+		case causenet::EdgeWeighting::InverseSupport:
+			return SectionId::EdgeWeightsInverseSupport;
+		case causenet::EdgeWeighting::NegLogConfidence:
+			return SectionId::EdgeWeightsNegLogConfidence;
+		default:
+			return SectionId::EdgeWeightsSourceTypeWeighted;
+		}
+	}
+	/** The weightings whose lengths are stored; EdgeWeighting::Hops needs none **/
+	static constexpr causenet::EdgeWeighting stored[] = {
+			causenet::EdgeWeighting::InverseSupport, causenet::EdgeWeighting::NegLogConfidence,
+			causenet::EdgeWeighting::SourceTypeWeighted
+	};
+
+	inline EdgeWeight quantize(double length) noexcept {
+		return (EdgeWeight)std::clamp(std::round(length), 1.0, (double)std::numeric_limits<EdgeWeight>::max());
+	}
+
+	/**
+	 * @brief Computes the lengths of the edges `counts[rows[u]..rows[u+1]]` of every node `u`.
+	 * @details The lengths of a node's edges only depend on that node's edges such that writers that produce the
+	 * adjacency row by row can call this once per row (with `rows = {0, n}`).
+	 */
+	inline std::vector<EdgeWeight> compute(
+			std::span<const std::uint64_t> rows, std::span<const SupportTypeCounts> counts,
+			causenet::EdgeWeighting weighting
+	) {
+		using causenet::EdgeWeighting;
+		auto numSupport = [](const SupportTypeCounts& c) {
+			double total = 0;
+			for (auto n : c.count)
+				total += n;
+			return total;
+		};
+		std::vector<EdgeWeight> lengths(counts.size());
+		for (size_t u = 0; u + 1 < rows.size(); ++u) {
+			double rowTotal = 0;
+			for (auto e = rows[u]; e < rows[u + 1]; ++e)
+				rowTotal += numSupport(counts[e]);
+			for (auto e = rows[u]; e < rows[u + 1]; ++e) {
+				double length = std::numeric_limits<double>::infinity();
+				if (weighting == EdgeWeighting::InverseSupport && numSupport(counts[e]) > 0) {
+					length = supportScale / numSupport(counts[e]);
+				} else if (weighting == EdgeWeighting::NegLogConfidence && numSupport(counts[e]) > 0) {
+					length = -std::log(numSupport(counts[e]) / rowTotal) * logScale;
+				} else if (weighting == EdgeWeighting::SourceTypeWeighted) {
+					double weighted = 0;
+					for (size_t t = 0; t < causenet::numSourceTypes; ++t)
+						weighted += typeWeights[t] * counts[e].count[t];
+					length = (weighted > 0) ? supportScale * typeWeights[0] / weighted : length;
+				} else if (weighting == EdgeWeighting::Hops) {
+					length = 1;
+				}
+				lengths[e] = quantize(length);
+			}
+		}
+		return lengths;
+	}
+} // namespace edgeweights
+
 static const EdgeEntry nulledge = {.targetIdx = (uint32_t)-1, .numSupport = 0, .supportOffset = 0};
 
 struct __attribute__((packed)) NodeEntry {
 	offset_t nameOffset;
-	offset_t effectOffset;
+	offset_t effectOffset; ///< Only used by version 1 files
 
 	inline const char* name(const Header& file) const { return file.nodeInfoBase() + nameOffset; }
 	inline const EdgeEntry* effects(const Header& file) const {
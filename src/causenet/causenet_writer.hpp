@@ -2,11 +2,15 @@
 #define CAUSENET_CAUSENETWRITER_HPP
 
 #include "./causenet_file.hpp"
+#include "./compressed_sources.hpp"
 #include <causenet/support.hpp>
+#include <utils/transpose.hpp>
 
+#include <algorithm>
 #include <cassert>
 #include <filesystem>
 #include <fstream>
+#include <iostream>
 #include <map>
 #include <tuple>
 #include <unordered_map>
@@ -40,49 +44,167 @@ struct std::hash<causenet::Support> {
 };
 
 namespace causenet::internal {
+	/**
+	 * @brief Concatenates the temporary files of a writer into the final file (see Causenet::jsonlToBinary()).
+	 * @details The constructor writes the header and the node list, node info and sources. The sections are appended
+	 * with writeSection() and finish() fills in the section table. If the sources are to be compressed, the SOURCES
+	 * are left empty and finish() appends the SupportBlocks, SupportDictionary and SupportBlockIndex sections instead.
+	 * The file is assembled as `<outfile>.tmp` and only renamed to `outfile` once finish() wrote it completely, such
+	 * that a reader, e.g. the server's file watch, never maps a partial file.
+	 */
+	class CausenetFileAssembler final {
+	private:
+		std::fstream& sourcesFile;
+		const bool compress;
+		const std::uint32_t numSections;
+		const size_t tableSize;
+
+		const std::filesystem::path outfile;
+		const std::filesystem::path tmpfile;
+		bool finished = false;
+		std::ofstream out;
+		std::vector<SectionEntry> sections;
+
+		void padTo8() {
+			static constexpr char zeros[8] = {};
+			out.write(zeros, (8 - out.tellp() % 8) % 8);
+		}
+
+	public:
+		CausenetFileAssembler(
+				const std::filesystem::path& outfile, size_t numNodes, std::fstream& nodesFile,
+				std::fstream& nodeInfoFile, std::fstream& sourcesFile, bool compressSources = false
+		)
+				: sourcesFile(sourcesFile), compress(compressSources), numSections(compressSources ? 16 : 13),
+				  tableSize(sizeof(SectionTable) + numSections * sizeof(SectionEntry)), outfile(outfile),
+				  tmpfile(std::filesystem::path(outfile) += ".tmp"),
+				  out(tmpfile, std::ios::binary | std::ios::trunc | std::ios::in | std::ios::out) {
+			assert(out);
+			Header header{
+					.numNodes = numNodes,
+					.conceptOffset = sizeof(Header) + tableSize,
+					.infoOffset = sizeof(Header) + tableSize + nodesFile.tellp(),
+					.supportOffset = sizeof(Header) + tableSize + nodesFile.tellp() + nodeInfoFile.tellp()
+			};
+			out.write(reinterpret_cast<const char*>(&header), sizeof(header));
+			SectionTable table{.magic = sectionMagic, .version = formatVersion, .numSections = numSections};
+			out.write(reinterpret_cast<const char*>(&table), sizeof(table));
+			// The sections are appended behind the sources such that we have to fill in the entries later
+			out.seekp(tableSize - sizeof(SectionTable), std::ios::cur);
+			assert(out.tellp() == header.conceptOffset);
+			append(nodesFile);
+			assert(out.tellp() == header.infoOffset);
+			append(nodeInfoFile);
+			assert(out.tellp() == header.supportOffset);
+			if (!compress)
+				append(sourcesFile);
+		}
+		CausenetFileAssembler(const CausenetFileAssembler&) = delete;
+		~CausenetFileAssembler() {
+			if (!finished) {
+				out.close();
+				std::error_code ec;
+				std::filesystem::remove(tmpfile, ec);
+			}
+		}
+
+		void append(std::fstream& tmp) {
+			// Streaming an empty buffer would set the failbit of out
+			if (tmp.tellp() == 0)
+				return;
+			tmp.seekg(0, std::ios::beg);
+			out << tmp.rdbuf();
+		}
+
+		template <typename T>
+		void writeSection(SectionId id, const std::vector<T>& data) {
+			padTo8();
+			sections.push_back({.id = id, .offset = (offset_t)out.tellp(), .size = data.size() * sizeof(T)});
+			out.write(reinterpret_cast<const char*>(data.data()), data.size() * sizeof(T));
+		}
+
+		void writeSection(SectionId id, std::fstream& tmp) {
+			padTo8();
+			sections.push_back({.id = id, .offset = (offset_t)out.tellp(), .size = (offset_t)tmp.tellp()});
+			append(tmp);
+		}
+
+		void finish() {
+			if (compress) {
+				padTo8();
+				const offset_t blocksOffset = out.tellp();
+				auto compressed = internal::compressSources(sourcesFile, sourcesFile.tellp(), out);
+				const offset_t blocksSize = (offset_t)out.tellp() - blocksOffset;
+				sections.push_back({.id = SectionId::SupportBlocks, .offset = blocksOffset, .size = blocksSize});
+				writeSection(SectionId::SupportDictionary, compressed.dictionary);
+				writeSection(SectionId::SupportBlockIndex, compressed.blockIndex);
+			}
+			assert(sections.size() == numSections);
+			out.seekp(sizeof(Header) + sizeof(SectionTable), std::ios::beg);
+			out.write(reinterpret_cast<const char*>(sections.data()), sections.size() * sizeof(SectionEntry));
+			out.close();
+			assert(out);
+			if (!out) {
+				std::cerr << "Cannot write " << tmpfile << std::endl;
+				return;
+			}
+			std::filesystem::rename(tmpfile, outfile);
+			finished = true;
+		}
+	};
+
 	class CausenetWriter final {
 	private:
 		std::filesystem::path outfile;
 		std::filesystem::path tmpfolder;
+		bool compressSources;
 		std::fstream nodesFile;
 		std::fstream nodeInfoFile;
 		std::fstream sourcesFile;
+		std::fstream supportListsFile;
+		std::fstream supportLengthsFile;
 
 		std::unordered_map<std::string, size_t> conceptToIdx;
 		std::unordered_map<Support, size_t> support2Offset;
+		struct SupportOccurrence {
+			offset_t offset;
+			SupportLength length;
+			SourceType type;
+		};
 		struct JSONNode {
 			std::string name;
-			std::map<size_t, std::vector<offset_t>> effects;
+			std::map<size_t, std::vector<SupportOccurrence>> effects;
 		};
 		std::vector<JSONNode> nodes;
 
-		void writeNodeWithInfo(const JSONNode& node) {
-			size_t infoOffset = writeNodeInfo(node);
-			NodeEntry entry{.nameOffset = infoOffset, .effectOffset = infoOffset += node.name.length() + 1};
-			nodesFile.write(reinterpret_cast<const char*>(&entry), sizeof(entry));
-		}
+		// Version 2 adjacency (CSR): the edges of node i are edgeTargets[edgeRows[i]..edgeRows[i+1]]
+		std::vector<std::uint64_t> edgeRows;
+		std::vector<std::uint32_t> edgeTargets;
+		std::vector<SupportRef> edgeSupport;
+		std::vector<SupportTypeCounts> edgeSupportTypes;
 
-		size_t writeNodeInfo(const JSONNode& node) {
-			size_t offset = nodeInfoFile.tellp();
-			size_t supportOffset = offset + node.name.length() + 1 + (node.effects.size() + 1) * sizeof(EdgeEntry);
+		void writeNodeWithInfo(JSONNode& node) {
+			NodeEntry entry{.nameOffset = (offset_t)nodeInfoFile.tellp(), .effectOffset = 0};
 			nodeInfoFile.write(node.name.c_str(), node.name.length() + 1);
-			for (const auto& [effect, supports] : node.effects) {
-				EdgeEntry edge = {
-						.targetIdx = (uint32_t)effect,
-						.numSupport = (uint32_t)supports.size(),
-						.supportOffset = supportOffset
-				};
-				nodeInfoFile.write(reinterpret_cast<const char*>(&edge), sizeof(edge));
-				supportOffset += supports.size() * sizeof(decltype(supports)::value_type);
-			}
-			// Terminate with the null-edge
-			nodeInfoFile.write(reinterpret_cast<const char*>(&nulledge), sizeof(nulledge));
-			// Write list of support offsets
-			for (const auto& [effect, supports] : node.effects) {
-				for (const auto& supoffset : supports)
-					nodeInfoFile.write(reinterpret_cast<const char*>(&supoffset), sizeof(supoffset));
+			nodesFile.write(reinterpret_cast<const char*>(&entry), sizeof(entry));
+			for (auto& [effect, supports] : node.effects) {
+				std::stable_sort(supports.begin(), supports.end(), [](const auto& a, const auto& b) {
+					return a.type < b.type;
+				});
+				edgeTargets.push_back((uint32_t)effect);
+				edgeSupport.push_back(
+						{.numSupport = (uint32_t)supports.size(),
+						 .reserved = 0,
+						 .listOffset = (offset_t)supportListsFile.tellp()}
+				);
+				auto& counts = edgeSupportTypes.emplace_back();
+				for (const auto& [offset, length, type] : supports) {
+					supportListsFile.write(reinterpret_cast<const char*>(&offset), sizeof(offset));
+					supportLengthsFile.write(reinterpret_cast<const char*>(&length), sizeof(length));
+					counts.count[static_cast<std::uint8_t>(type)]++;
+				}
 			}
-			return offset;
+			edgeRows.push_back(edgeTargets.size());
 		}
 
 		size_t writeSupport(const Support& support) {
@@ -96,41 +218,57 @@ namespace causenet::internal {
 		}
 
 		void writeOutfile() {
-			std::ofstream out(outfile, std::ios::binary | std::ios::trunc | std::ios::in | std::ios::out);
-			assert(out);
-			Header header{
-					.numNodes = conceptToIdx.size(),
-					.conceptOffset = sizeof(Header),
-					.infoOffset = sizeof(Header) + nodesFile.tellp(),
-					.supportOffset = sizeof(Header) + nodesFile.tellp() + nodeInfoFile.tellp()
-			};
-			out.write(reinterpret_cast<const char*>(&header), sizeof(header));
-			assert(out.tellp() == header.conceptOffset);
-			nodesFile.seekg(0, std::ios::beg);
-			out << nodesFile.rdbuf();
-			assert(out.tellp() == header.infoOffset);
-			nodeInfoFile.seekg(0, std::ios::beg);
-			out << nodeInfoFile.rdbuf();
-			assert(out.tellp() == header.supportOffset);
-			sourcesFile.seekg(0, std::ios::beg);
-			out << sourcesFile.rdbuf();
+			CausenetFileAssembler out(
+					outfile, conceptToIdx.size(), nodesFile, nodeInfoFile, sourcesFile, compressSources
+			);
+			out.writeSection(
+					SectionId::NameIndex,
+					nameindex::build(nodes.size(), [this](size_t i) -> std::string_view { return nodes[i].name; })
+			);
+			out.writeSection(SectionId::EdgeRows, edgeRows);
+			out.writeSection(SectionId::EdgeTargets, edgeTargets);
+			out.writeSection(SectionId::EdgeSupport, edgeSupport);
+			out.writeSection(SectionId::SupportLists, supportListsFile);
+			auto causes = utils::transpose(edgeRows, edgeTargets);
+			out.writeSection(SectionId::CauseRows, causes.rows);
+			out.writeSection(SectionId::CauseSources, causes.sources);
+			out.writeSection(SectionId::CauseEdges, causes.edges);
+			out.writeSection(SectionId::SupportLengths, supportLengthsFile);
+			out.writeSection(SectionId::SupportTypeCounts, edgeSupportTypes);
+			for (auto weighting : edgeweights::stored)
+				out.writeSection(
+						edgeweights::section(weighting), edgeweights::compute(edgeRows, edgeSupportTypes, weighting)
+				);
+			out.finish();
 		}
 
 	public:
-		explicit CausenetWriter(std::filesystem::path outfile) noexcept
-				: CausenetWriter(outfile, outfile.parent_path()) {}
-		CausenetWriter(std::filesystem::path outfile, std::filesystem::path tmpfolder) noexcept
-				: outfile(outfile), tmpfolder(tmpfolder),
+		explicit CausenetWriter(std::filesystem::path outfile, bool compressSources = false) noexcept
+				: CausenetWriter(outfile, outfile.parent_path(), compressSources) {}
+		CausenetWriter(
+				std::filesystem::path outfile, std::filesystem::path tmpfolder, bool compressSources = false
+		) noexcept
+				: outfile(outfile), tmpfolder(tmpfolder), compressSources(compressSources),
 				  nodesFile(tmpfolder / "nodes.tmp", std::ios::binary | std::ios::trunc | std::ios::in | std::ios::out),
 				  nodeInfoFile(
 						  tmpfolder / "nodeinfo.tmp", std::ios::binary | std::ios::trunc | std::ios::in | std::ios::out
 				  ),
 				  sourcesFile(
 						  tmpfolder / "sources.tmp", std::ios::binary | std::ios::trunc | std::ios::in | std::ios::out
+				  ),
+				  supportListsFile(
+						  tmpfolder / "supportlists.tmp",
+						  std::ios::binary | std::ios::trunc | std::ios::in | std::ios::out
+				  ),
+				  supportLengthsFile(
+						  tmpfolder / "supportlengths.tmp",
+						  std::ios::binary | std::ios::trunc | std::ios::in | std::ios::out
 				  ) {
 			assert(nodesFile);
 			assert(nodeInfoFile);
 			assert(sourcesFile);
+			assert(supportListsFile);
+			assert(supportLengthsFile);
 		}
 
 		~CausenetWriter() { close(); }
@@ -138,11 +276,19 @@ namespace causenet::internal {
 		void close() {
 			std::cout << "Num Concepts: " << conceptToIdx.size() << std::endl;
 			std::cout << "Num Supports: " << support2Offset.size() << std::endl;
+			edgeRows = {0};
 			for (auto&& node : nodes)
 				writeNodeWithInfo(node);
 			writeOutfile();
 		}
 
+		/** Numbers the concept unless it is known already; concepts are numbered in the order they are first seen **/
+		void writeConcept(const std::string& name) {
+			auto [idx, inserted] = insertOrGet(conceptToIdx, name, nodes.size());
+			if (inserted)
+				nodes.push_back({name});
+		}
+
 		void writeEdge(const std::string& from, const std::string& to, std::vector<Support> supports) {
 			auto [causeIdx, cInserted] = insertOrGet(conceptToIdx, from, nodes.size());
 			if (cInserted)
@@ -152,7 +298,10 @@ namespace causenet::internal {
 				nodes.push_back({to});
 			auto& supportOffsets = nodes[causeIdx].effects[effectIdx];
 			for (auto&& support : supports) {
-				supportOffsets.emplace_back(writeSupport(support));
+				SupportLength length{
+						.id = (uint32_t)support.id.length(), .content = (uint32_t)support.content.length()
+				};
+				supportOffsets.push_back({writeSupport(support), length, support.sourceTypeId});
 			}
 		}
 	}; // namespace causenet::internal
@@ -0,0 +1,176 @@
+#include "./compressed_sources.hpp"
+
+#include <utils/transpose.hpp>
+
+#include <zdict.h>
+#include <zstd.h>
+
+#include <algorithm>
+#include <atomic>
+#include <cstring>
+#include <format>
+#include <istream>
+#include <ostream>
+#include <stdexcept>
+#include <thread>
+
+using causenet::internal::CompressedSources;
+using causenet::internal::CompressedSourcesSections;
+
+namespace {
+	std::atomic<std::uint64_t> nextId = 1;
+
+	struct Scratch {
+		std::uint64_t owner = 0;
+		std::uint64_t first = 0, last = 0; ///< The decompressed blocks [first, last)
+		std::vector<char> buffer;
+		ZSTD_DCtx* ctx = ZSTD_createDCtx();
+
+		~Scratch() { ZSTD_freeDCtx(ctx); }
+	};
+	thread_local Scratch scratch;
+} // namespace
+
+CompressedSources::CompressedSources(
+		SupportBlockHeader info, std::span<const offset_t> blockOffsets, const char* blocks, ZSTD_DDict* dictionary
+) noexcept
+		: info(info), blockOffsets(blockOffsets), blocks(blocks), dictionary(dictionary), id(nextId++) {}
+CompressedSources::~CompressedSources() { ZSTD_freeDDict(dictionary); }
+
+std::unique_ptr<CompressedSources> CompressedSources::open(const Header& header) {
+	auto index = header.section<char>(SectionId::SupportBlockIndex);
+	auto blocks = header.section<char>(SectionId::SupportBlocks);
+	if (index.size() < sizeof(SupportBlockHeader))
+		return nullptr;
+	SupportBlockHeader info;
+	std::memcpy(&info, index.data(), sizeof(info));
+	std::span offsets{reinterpret_cast<const offset_t*>(index.data() + sizeof(info)), info.numBlocks + 1ull};
+	if (index.size() != sizeof(info) + offsets.size_bytes() || info.blockSize == 0 ||
+		info.rawSize > std::uint64_t{info.numBlocks} * info.blockSize || !std::ranges::is_sorted(offsets) ||
+		offsets.back() > blocks.size())
+		throw std::runtime_error("Invalid CauseNet file: compressed sources");
+	auto dictionary = header.section<char>(SectionId::SupportDictionary);
+	return std::unique_ptr<CompressedSources>(new CompressedSources(
+			info, offsets, blocks.data(), ZSTD_createDDict(dictionary.data(), dictionary.size())
+	));
+}
+
+const char* CompressedSources::read(offset_t offset, std::size_t size) const {
+	const std::uint64_t first = offset / info.blockSize;
+	const std::uint64_t last = (offset + std::max<std::size_t>(size, 1) - 1) / info.blockSize + 1;
+	if (scratch.owner != id || first < scratch.first || last > scratch.last) {
+		scratch.owner = 0; // Stays invalid should decompression fail
+		scratch.buffer.resize((last - first) * info.blockSize);
+		for (auto block = first; block < last; ++block) {
+			auto n = ZSTD_decompress_usingDDict(
+					scratch.ctx, scratch.buffer.data() + (block - first) * info.blockSize, info.blockSize,
+					blocks + blockOffsets[block], blockOffsets[block + 1] - blockOffsets[block], dictionary
+			);
+			// Only the last block may be shorter
+			if (ZSTD_isError(n) || n != std::min<std::uint64_t>(info.blockSize, info.rawSize - block * info.blockSize))
+				return nullptr;
+		}
+		scratch.owner = id;
+		scratch.first = first;
+		scratch.last = last;
+	}
+	return scratch.buffer.data() + (offset - scratch.first * info.blockSize);
+}
+
+const char*
+causenet::internal::readSources(const CompressedSources& sources, std::uint64_t offset, std::size_t size) {
+	return sources.read(offset, size);
+}
+
+CompressedSourcesSections causenet::internal::compressSources(
+		std::istream& in, std::uint64_t rawSize, std::ostream& blocks, std::uint32_t blockSize, int level
+) {
+	static constexpr size_t dictionaryCapacity = 112640; // zstd's default
+	static constexpr size_t maxSamples = 8192;
+	const std::uint64_t numBlocks = (rawSize + blockSize - 1) / blockSize;
+	auto blockLength = [&](std::uint64_t block) {
+		return std::min<std::uint64_t>(blockSize, rawSize - block * blockSize);
+	};
+
+	// Train the dictionary on blocks spread evenly over the sources; zstd recommends the samples to be of the size of
+	// the units compressed with it
+	CompressedSourcesSections result;
+	{
+		const auto numSamples = std::min<std::uint64_t>(numBlocks, maxSamples);
+		std::vector<char> samples;
+		std::vector<size_t> sampleSizes;
+		for (std::uint64_t i = 0; i < numSamples; ++i) {
+			auto block = i * numBlocks / numSamples;
+			sampleSizes.push_back(blockLength(block));
+			samples.resize(samples.size() + sampleSizes.back());
+			in.seekg(block * blockSize);
+			in.read(samples.data() + samples.size() - sampleSizes.back(), sampleSizes.back());
+		}
+		if (!in)
+			throw std::runtime_error("Cannot read the sources to compress");
+		result.dictionary.resize(dictionaryCapacity);
+		auto size = ZDICT_trainFromBuffer(
+				result.dictionary.data(), result.dictionary.size(), samples.data(), sampleSizes.data(),
+				static_cast<unsigned>(sampleSizes.size())
+		);
+		// Training fails if there is too little data, which then compresses well enough without a dictionary
+		result.dictionary.resize(ZDICT_isError(size) ? 0 : size);
+	}
+
+	SupportBlockHeader info{.rawSize = rawSize, .blockSize = blockSize, .numBlocks = (std::uint32_t)numBlocks};
+	if (info.numBlocks != numBlocks)
+		throw std::runtime_error(std::format("Cannot compress {} bytes in blocks of {} bytes", rawSize, blockSize));
+	std::vector<offset_t> offsets{0};
+	offsets.reserve(numBlocks + 1);
+
+	// Blocks are compressed in batches by all threads and written in order
+	const unsigned numThreads = std::max(std::thread::hardware_concurrency(), 1u);
+	const std::uint64_t batchSize = 1024 * numThreads;
+	// Released however the compression ends
+	std::unique_ptr<ZSTD_CDict, decltype(&ZSTD_freeCDict)> cdict(
+			ZSTD_createCDict(result.dictionary.data(), result.dictionary.size(), level), &ZSTD_freeCDict
+	);
+	std::vector<std::unique_ptr<ZSTD_CCtx, decltype(&ZSTD_freeCCtx)>> contexts;
+	for (unsigned t = 0; t < numThreads; ++t)
+		contexts.emplace_back(ZSTD_createCCtx(), &ZSTD_freeCCtx);
+	if (cdict == nullptr || std::ranges::any_of(contexts, [](const auto& ctx) { return ctx == nullptr; }))
+		throw std::runtime_error("Cannot create the zstd compression contexts");
+	std::vector<char> raw(batchSize * blockSize);
+	std::vector<std::vector<char>> compressed(batchSize);
+	in.seekg(0);
+	for (std::uint64_t begin = 0; begin < numBlocks; begin += batchSize) {
+		const auto end = std::min(begin + batchSize, numBlocks);
+		if (!in.read(raw.data(), (end - 1) * blockSize + blockLength(end - 1) - begin * blockSize))
+			throw std::runtime_error("Cannot read the sources to compress");
+		std::atomic<size_t> error = 0;
+		utils::parallelFor(numThreads, [&](unsigned t) {
+			for (auto block = begin + t; block < end; block += numThreads) {
+				auto& out = compressed[block - begin];
+				out.resize(ZSTD_compressBound(blockSize));
+				auto n = ZSTD_compress_usingCDict(
+						contexts[t].get(), out.data(), out.size(), raw.data() + (block - begin) * blockSize,
+						blockLength(block), cdict.get()
+				);
+				if (ZSTD_isError(n)) {
+					error.store(n, std::memory_order_relaxed);
+					return;
+				}
+				out.resize(n);
+			}
+		});
+		if (auto n = error.load(std::memory_order_relaxed); n != 0)
+			throw std::runtime_error(std::format("Cannot compress the sources: {}", ZSTD_getErrorName(n)));
+		for (auto block = begin; block < end; ++block) {
+			auto& out = compressed[block - begin];
+			blocks.write(out.data(), out.size());
+			offsets.push_back(offsets.back() + out.size());
+		}
+	}
+	if (!blocks)
+		throw std::runtime_error("Cannot write the compressed sources");
+
+	result.blockIndex.resize(sizeof(info) + offsets.size() * sizeof(offset_t));
+	std::memcpy(result.blockIndex.data(), &info, sizeof(info));
+	std::memcpy(result.blockIndex.data() + sizeof(info), offsets.data(), offsets.size() * sizeof(offset_t));
+	return result;
+}
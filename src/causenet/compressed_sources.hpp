@@ -0,0 +1,78 @@
+#ifndef CAUSENET_COMPRESSEDSOURCES_HPP
+#define CAUSENET_COMPRESSEDSOURCES_HPP
+
+#include "./causenet_file.hpp"
+
+#include <cinttypes>
+#include <iosfwd>
+#include <memory>
+#include <span>
+#include <vector>
+
+struct ZSTD_DDict_s;
+
+/**
+ * @brief Header of the SupportBlockIndex section; followed by `numBlocks + 1` offsets into the SupportBlocks section.
+ * @details Block `b` holds the bytes `[b * blockSize, (b + 1) * blockSize)` of the uncompressed SOURCES, compressed
+ * with zstd and the dictionary from the SupportDictionary section. Supports may span block boundaries.
+ */
+struct __attribute__((packed)) SupportBlockHeader {
+	std::uint64_t rawSize;
+	std::uint32_t blockSize;
+	std::uint32_t numBlocks;
+};
+static_assert(sizeof(SupportBlockHeader) == 16);
+
+namespace causenet::internal {
+	/**
+	 * @brief Decompresses the blocks of the SOURCES that a support lies in on demand.
+	 * @details Every thread decompresses into its own scratch buffer, which is reused until a support from other blocks
+	 * is requested.
+	 */
+	class CompressedSources final {
+	private:
+		SupportBlockHeader info;
+		std::span<const offset_t> blockOffsets;
+		const char* blocks;
+		ZSTD_DDict_s* dictionary;
+		std::uint64_t id; ///< Identifies the instance within the scratch buffers; unlike the address never reused
+
+		CompressedSources(
+				SupportBlockHeader info, std::span<const offset_t> blockOffsets, const char* blocks,
+				ZSTD_DDict_s* dictionary
+		) noexcept;
+
+	public:
+		CompressedSources(const CompressedSources&) = delete;
+		~CompressedSources();
+
+		/** @returns nullptr if the file stores the SOURCES uncompressed **/
+		static std::unique_ptr<CompressedSources> open(const Header& header);
+
+		/**
+		 * @returns a pointer to the `size` uncompressed bytes at `offset`, which stays valid until the calling thread
+		 * reads from other blocks, or nullptr if one of the blocks does not decompress to its size (i.e., is corrupt).
+		 */
+		const char* read(offset_t offset, std::size_t size) const;
+		/** The size of the uncompressed SOURCES **/
+		std::uint64_t rawSize() const noexcept { return info.rawSize; }
+	};
+
+	/** @brief The sections replacing the SOURCES; see compressSources() **/
+	struct CompressedSourcesSections {
+		std::vector<char> dictionary;
+		std::vector<char> blockIndex; ///< SupportBlockHeader followed by the block offsets
+	};
+
+	/**
+	 * @brief Compresses the `rawSize` bytes of SOURCES in `in` block by block with a dictionary trained on a sample of
+	 * the blocks and writes the blocks to `blocks`.
+	 * @throws std::runtime_error if reading, compressing or writing fails
+	 */
+	CompressedSourcesSections compressSources(
+			std::istream& in, std::uint64_t rawSize, std::ostream& blocks, std::uint32_t blockSize = 4096,
+			int level = 12
+	);
+} // namespace causenet::internal
+
+#endif
@@ -0,0 +1,123 @@
+#include <causenet/landmarks.hpp>
+
+#include <algorithm>
+#include <cstring>
+#include <format>
+#include <fstream>
+#include <stdexcept>
+
+// Linux only headers :(
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <unistd.h>
+
+using causenet::EdgeWeighting;
+using causenet::LandmarkHeader;
+using causenet::LandmarkIndex;
+namespace fs = std::filesystem;
+
+/** Offset of the distances behind the header and the landmarks **/
+static std::size_t distanceOffset(std::uint32_t numLandmarks) noexcept {
+	return sizeof(LandmarkHeader) + (numLandmarks * sizeof(std::uint32_t) + 7) / 8 * 8;
+}
+
+LandmarkIndex::LandmarkIndex(int fd, const char* data, std::size_t size) noexcept : fd(fd), data(data), size(size) {}
+LandmarkIndex::~LandmarkIndex() {
+	munmap(const_cast<char*>(data), size);
+	::close(fd);
+}
+
+std::unique_ptr<LandmarkIndex> LandmarkIndex::open(const fs::path& path, const Causenet& causenet) {
+	std::error_code ec;
+	auto size = fs::file_size(path, ec);
+	if (ec || size < sizeof(LandmarkHeader))
+		return nullptr;
+	int fd = ::open(path.c_str(), O_RDONLY);
+	if (fd < 0)
+		return nullptr;
+	auto mapped = mmap(nullptr, size, PROT_READ, MAP_SHARED, fd, 0);
+	if (mapped == MAP_FAILED) {
+		::close(fd);
+		return nullptr;
+	}
+	std::unique_ptr<LandmarkIndex> index(new LandmarkIndex(fd, reinterpret_cast<const char*>(mapped), size));
+	const auto& header = index->header();
+	const auto graph = causenet.effectGraph();
+	if (header.magic != landmarkMagic || header.numLandmarks == 0 || header.numNodes != causenet.numConcepts() ||
+		header.numEdges != graph.adj.size() || static_cast<size_t>(header.weighting) >= numEdgeWeightings ||
+		size != distanceOffset(header.numLandmarks) +
+						2 * header.numNodes * header.numLandmarks * sizeof(std::uint32_t) ||
+		header.fingerprint != fingerprint(causenet, header.weighting))
+		return nullptr;
+	return index;
+}
+
+std::uint64_t LandmarkIndex::fingerprint(const Causenet& causenet, EdgeWeighting weighting) noexcept {
+	std::uint64_t hash = 0x9e3779b97f4a7c15ull;
+	// Word by word since the topology may take up gigabytes
+	auto mix = [&hash](std::span<const std::byte> bytes) {
+		for (size_t i = 0; i < bytes.size(); i += sizeof(std::uint64_t)) {
+			std::uint64_t word = 0;
+			std::memcpy(&word, bytes.data() + i, std::min(sizeof(word), bytes.size() - i));
+			hash = (hash ^ word) * 0xff51afd7ed558ccdull;
+			hash ^= hash >> 32;
+		}
+		hash = (hash ^ bytes.size()) * 0xc4ceb9fe1a85ec53ull;
+	};
+	const auto graph = causenet.effectGraph();
+	mix(std::as_bytes(graph.rows));
+	mix(std::as_bytes(graph.adj));
+	mix(std::as_bytes(causenet.edgeWeights(weighting)));
+	return hash;
+}
+
+std::span<const std::uint32_t> LandmarkIndex::landmarks() const noexcept {
+	return {reinterpret_cast<const std::uint32_t*>(data + sizeof(LandmarkHeader)), header().numLandmarks};
+}
+
+utils::LandmarkBounds LandmarkIndex::bounds() const noexcept {
+	const size_t count = header().numNodes * header().numLandmarks;
+	auto from = reinterpret_cast<const std::uint32_t*>(data + distanceOffset(header().numLandmarks));
+	return {.numLandmarks = header().numLandmarks, .from = {from, count}, .to = {from + count, count}};
+}
+
+void LandmarkIndex::build(
+		const Causenet& causenet, const fs::path& out, size_t numLandmarks, utils::LandmarkSelection selection,
+		EdgeWeighting weighting, unsigned numThreads
+) {
+	const auto forward = causenet.effectGraph(), backward = causenet.causeGraph();
+	const auto weights = causenet.edgeWeights(weighting);
+	auto weight = [weights](std::uint64_t edge) -> std::uint64_t { return weights.empty() ? 1 : weights[edge]; };
+	auto landmarks = utils::selectLandmarks(forward, backward, numLandmarks, selection, weight, numThreads);
+
+	// Written next to `out` and renamed such that the server never maps a partial file
+	auto tmp = out;
+	tmp += ".tmp";
+	std::ofstream file(tmp, std::ios::binary | std::ios::trunc);
+	if (!file)
+		throw std::runtime_error(std::format("Cannot write {}", tmp.string()));
+	LandmarkHeader header{
+			.magic = landmarkMagic,
+			.numNodes = causenet.numConcepts(),
+			.numEdges = forward.adj.size(),
+			.numLandmarks = (std::uint32_t)landmarks.nodes.size(),
+			.weighting = weighting,
+			.reserved = {},
+			.fingerprint = fingerprint(causenet, weighting)
+	};
+	file.write(reinterpret_cast<const char*>(&header), sizeof(header));
+	file.write(
+			reinterpret_cast<const char*>(landmarks.nodes.data()), landmarks.nodes.size() * sizeof(std::uint32_t)
+	);
+	static constexpr char zeros[8] = {};
+	file.write(zeros, distanceOffset(header.numLandmarks) - file.tellp());
+	file.write(reinterpret_cast<const char*>(landmarks.from.data()), landmarks.from.size() * sizeof(std::uint32_t));
+	file.write(reinterpret_cast<const char*>(landmarks.to.data()), landmarks.to.size() * sizeof(std::uint32_t));
+	file.close();
+	if (!file) {
+		std::error_code ec;
+		fs::remove(tmp, ec);
+		throw std::runtime_error(std::format("Cannot write {}", tmp.string()));
+	}
+	fs::rename(tmp, out);
+}
@@ -1,30 +1,254 @@
 #include <causenet/rest/controller_v1.hpp>
 
+#include "./json.hpp"
+#include "./metrics.hpp"
+
+#include <drogon/HttpAppFramework.h>
+
 #include <utils/shortest_paths.hpp>
 #include <warc.hpp>
 
 #include <boost/iostreams/filter/gzip.hpp>
 #include <boost/iostreams/filtering_stream.hpp>
 
+#include <array>
+#include <atomic>
+#include <charconv>
+#include <cstdlib>
 #include <filesystem>
 #include <fstream>
+#include <initializer_list>
 #include <iostream>
+#include <limits>
+#include <mutex>
+#include <optional>
 #include <regex>
+#include <thread>
+#include <unordered_map>
 #include <vector>
 
+#include <sys/stat.h>
+
 using causenet::Causenet;
 using namespace causenet::rest::v1;
+using DRCallback = std::function<void(const drogon::HttpResponsePtr&)>;
+namespace metrics = causenet::rest::metrics;
+using metrics::Phase;
+using metrics::Route;
+
+std::filesystem::path Controller::causenetPath;
+std::filesystem::path Controller::landmarkPath;
+std::unique_ptr<ResponseCache> Controller::responseCache;
+std::unique_ptr<utils::WorkerPool> Controller::workers;
+/** Limits of the requests per route that wait for or run on Controller::workers **/
+static std::array<utils::ConcurrencyLimit, metrics::numRoutes> workerLimits;
+
+static utils::ConcurrencyLimit& workerLimit(Route route) { return workerLimits[static_cast<size_t>(route)]; }
+
+/** Replaced by Controller::reload(); requests copy it out such that a replaced snapshot lives on until they end **/
+static std::atomic<std::shared_ptr<const Snapshot>> currentSnapshot;
+static std::atomic<size_t> numSnapshots = 0;
+/** Set while the reloader runs; it clears it last such that the next reload only has to join it **/
+static std::atomic<bool> reloading = false;
+static std::jthread reloader;
+/**
+ * Graph file that could not be loaded; the file watch does not retry it until it is replaced again. Written by the
+ * reloader and read by the file watch.
+ */
+static FileIdentity rejectedFile;
+static std::mutex rejectedFileMutex;
+
+static void rejectFile(const FileIdentity& file) {
+	std::lock_guard lock(rejectedFileMutex);
+	rejectedFile = file;
+}
+static bool isRejected(const FileIdentity& file) {
+	std::lock_guard lock(rejectedFileMutex);
+	return file == rejectedFile;
+}
+
+FileIdentity FileIdentity::of(const std::filesystem::path& path) noexcept {
+	struct stat info;
+	if (::stat(path.c_str(), &info) != 0)
+		return {};
+	return {.device = info.st_dev,
+			.inode = info.st_ino,
+			.modified = info.st_mtim.tv_sec * 1'000'000'000ll + info.st_mtim.tv_nsec,
+			.size = (std::uint64_t)info.st_size};
+}
 
-std::unique_ptr<CausenetWrapper> Controller::causenet;
+Snapshot::Snapshot(causenet::Causenet&& causenet, std::uint64_t generation) noexcept
+		: causenet(std::move(causenet)), generation(generation) {
+	++numSnapshots;
+}
+Snapshot::~Snapshot() {
+	--numSnapshots;
+	LOG_INFO << "Unmapped snapshot " << generation;
+}
+size_t Snapshot::numAlive() noexcept { return numSnapshots; }
+
+/** Reads `custom_config.load` (see causenet::LoadOptions) **/
+static causenet::LoadOptions loadOptions() {
+	const auto& config = drogon::app().getCustomConfig()["load"];
+	return {
+			.populate = config.get("populate", false).asBool(),
+			.prefault = config.get("prefault", true).asBool(),
+			.advise = config.get("advise", true).asBool(),
+			.lock = config.get("lock", false).asBool(),
+			.hugePages = config.get("huge_pages", false).asBool()
+	};
+}
+
+/**
+ * @brief Maps and warms up Controller::causenetPath and the landmarks at Controller::landmarkPath.
+ * @returns nullptr if the graph file is missing or invalid
+ */
+static std::shared_ptr<const Snapshot> loadSnapshot(std::uint64_t generation) {
+	// Taken before loading such that a file that is replaced meanwhile is seen as changed by the file watch
+	const auto causenetFile = FileIdentity::of(Controller::causenetPath);
+	const auto landmarkFile = FileIdentity::of(Controller::landmarkPath);
+	if (causenetFile.size == 0) {
+		LOG_ERROR << "No CauseNet at " << Controller::causenetPath;
+		rejectFile(causenetFile);
+		return nullptr;
+	}
+	// A corrupt file must not take down a running server, nor be retried until it is replaced
+	try {
+		const auto options = loadOptions();
+		auto snapshot = std::make_shared<Snapshot>(Causenet::fromFile(Controller::causenetPath, options), generation);
+		snapshot->causenetFile = causenetFile;
+		snapshot->landmarkFile = landmarkFile;
+		const auto& causenet = snapshot->causenet;
+		const auto& stats = causenet.loadStats();
+		LOG_INFO << "Loaded CauseNet (format v" << causenet.formatVersion() << ") with " << causenet.numConcepts()
+				 << " nodes in " << stats.duration.count() << " ms as snapshot " << generation;
+		if (options.lock && stats.lockedBytes < stats.topologyBytes)
+			LOG_WARN << "Locked only " << (stats.lockedBytes >> 20) << " of " << (stats.topologyBytes >> 20)
+					 << " MiB of the topology; raise RLIMIT_MEMLOCK to lock all of it";
+		if (options.hugePages)
+			LOG_INFO << "Copied " << (stats.hugePageBytes >> 20) << " MiB of the topology into huge pages";
+		snapshot->landmarks = causenet::LandmarkIndex::open(Controller::landmarkPath, causenet);
+		if (snapshot->landmarks)
+			LOG_INFO << "Loaded " << snapshot->landmarks->header().numLandmarks
+					 << " landmarks for the path search weighted by "
+					 << causenet::edgeWeightingName(snapshot->landmarks->header().weighting);
+		else
+			LOG_INFO << "No landmarks found for this graph; paths are searched without them (see causenet_landmarks)";
+		return snapshot;
+	} catch (const std::exception& e) {
+		LOG_ERROR << "Cannot load " << Controller::causenetPath << ": " << e.what();
+		rejectFile(causenetFile);
+		return nullptr;
+	}
+}
+
+std::shared_ptr<const Snapshot> Controller::snapshot() noexcept { return currentSnapshot.load(); }
+
+/**
+ * In-flight requests finish on the snapshot they started on. The responses cached for older snapshots are never hit
+ * again (see respondFromCache()) and age out of the ResponseCache.
+ */
+bool Controller::reload() {
+	if (reloading.exchange(true))
+		return false;
+	if (reloader.joinable())
+		reloader.join();
+	reloader = std::jthread([] {
+		const auto generation = currentSnapshot.load()->generation + 1;
+		if (auto snapshot = loadSnapshot(generation)) {
+			currentSnapshot.store(std::move(snapshot));
+			LOG_INFO << "Swapped in snapshot " << generation;
+		}
+		reloading = false;
+	});
+	return true;
+}
 
+/**
+ * Loads and warms up the graph before anything else. drogon only starts listening once the controllers are
+ * constructed, such that the server does not report ready (i.e., accept connections) before the warmup is done.
+ */
 Controller::Controller() noexcept {
-	Controller::causenet = std::make_unique<CausenetWrapper>(
-			std::filesystem::current_path() / ".data" / "causenet-full-supported-reworked.causenet"
-	);
-	LOG_INFO << "Loaded CauseNet with " << causenet->get().numConcepts() << " nodes";
+	const auto& custom = drogon::app().getCustomConfig();
+	causenetPath = std::filesystem::current_path() /
+				   custom.get("causenet", ".data/causenet-full-supported-reworked.causenet").asString();
+	landmarkPath = std::filesystem::current_path() / custom.get("landmarks", ".data/causenet.landmarks").asString();
+	auto snapshot = loadSnapshot(0);
+	if (snapshot == nullptr) {
+		LOG_FATAL << "Cannot serve without a graph; see custom_config.causenet";
+		std::exit(1);
+	}
+	currentSnapshot.store(std::move(snapshot));
+	// Replacing the files (by renaming a new one over them; overwriting a mapped file corrupts the running snapshot)
+	// triggers a reload
+	if (const auto interval = custom["reload"].get("watch_interval_s", 0.0).asDouble(); interval > 0) {
+		drogon::app().getLoop()->runEvery(interval, [] {
+			const auto current = Controller::snapshot();
+			const auto causenetFile = FileIdentity::of(causenetPath);
+			if ((causenetFile != current->causenetFile && !isRejected(causenetFile)) ||
+				FileIdentity::of(landmarkPath) != current->landmarkFile)
+				reload();
+		});
+		LOG_INFO << "Watching " << causenetPath << " and " << landmarkPath << " for changes";
+	}
+	const auto& config = drogon::app().getCustomConfig()["response_cache"];
+	if (config.get("enabled", true).asBool()) {
+		const size_t capacity = config.get("capacity_mb", 256).asUInt64() << 20;
+		responseCache = std::make_unique<ResponseCache>(capacity, config.get("shards", 16).asUInt());
+		LOG_INFO << "Caching up to " << (capacity >> 20) << " MiB of responses";
+	}
+	const auto& workerConfig = drogon::app().getCustomConfig()["workers"];
+	size_t numWorkers = workerConfig.get("threads", 0).asUInt();
+	if (numWorkers == 0)
+		numWorkers = std::max(std::thread::hardware_concurrency(), 1u);
+	workers = std::make_unique<utils::WorkerPool>(numWorkers, workerConfig.get("max_queued", 256).asUInt64());
+	const auto& limits = workerConfig["max_in_flight"];
+	workerLimit(Route::Path).setLimit(limits.get("path", 64).asUInt64());
+	workerLimit(Route::Batch).setLimit(limits.get("batch", 32).asUInt64());
+	workerLimit(Route::ClueWebContent).setLimit(limits.get("clueweb_content", 32).asUInt64());
+	workerLimit(Route::ClueWebInfo).setLimit(limits.get("clueweb_info", 32).asUInt64());
+	LOG_INFO << "Running path searches, batches and ClueWeb12 lookups on " << numWorkers << " workers";
+	LOG_INFO << "Ready";
+}
+
+/**
+ * @brief Counts the request towards `route` in the metrics.
+ * @details `callback` is wrapped such that the status and the latency are recorded once the response is handed over.
+ */
+static void instrument(Route route, DRCallback& callback) {
+	metrics::requestStarted(route);
+	auto start = metrics::Clock::now();
+	callback = [route, start, callback = std::move(callback)](const drogon::HttpResponsePtr& resp) {
+		callback(resp);
+		metrics::requestFinished(route, resp->statusCode(), metrics::Clock::now() - start);
+	};
+}
+
+/** Serializes `val` right away rather than when the response is sent such that it is timed as its own phase **/
+static drogon::HttpResponsePtr newJsonResponse(const Json::Value& val) {
+	static const auto builder = [] {
+		Json::StreamWriterBuilder builder;
+		builder["indentation"] = "";
+		return builder;
+	}();
+	auto body = metrics::timed(Phase::JSONSerialization, [&val] { return Json::writeString(builder, val); });
+	auto resp = drogon::HttpResponse::newHttpResponse();
+	resp->setContentTypeCode(drogon::CT_APPLICATION_JSON);
+	resp->setBody(std::move(body));
+	return resp;
+}
+
+/** Rejects a request that would exceed the limits of Controller::workers **/
+static drogon::HttpResponsePtr newUnavailableResponse() {
+	auto resp = drogon::HttpResponse::newHttpResponse();
+	resp->setStatusCode(drogon::k503ServiceUnavailable);
+	resp->addHeader("Retry-After", "1");
+	resp->addHeader("Access-Control-Allow-Origin", "*");
+	return resp;
 }
 
 void Controller::index(const drogon::HttpRequestPtr& req, DRCallback&& callback) {
+	instrument(Route::Index, callback);
 	auto resp = drogon::HttpResponse::newHttpResponse();
 	resp->setStatusCode(drogon::k200OK);
 	resp->setContentTypeCode(drogon::CT_TEXT_PLAIN);
@@ -32,19 +256,198 @@ void Controller::index(const drogon::HttpRequestPtr& req, DRCallback&& callback)
 	callback(resp);
 }
 
-Nodes::Nodes() noexcept : causenet(Controller::causenet->get()) {}
+void Controller::getCacheStats(const drogon::HttpRequestPtr& req, DRCallback&& callback) {
+	instrument(Route::CacheStats, callback);
+	Json::Value val;
+	val["enabled"] = responseCache != nullptr;
+	if (responseCache != nullptr) {
+		auto stats = responseCache->stats();
+		val["hits"] = (Json::UInt64)stats.hits;
+		val["misses"] = (Json::UInt64)stats.misses;
+		val["entries"] = (Json::UInt64)stats.entries;
+		val["bytes"] = (Json::UInt64)stats.charge;
+	}
+	auto resp = drogon::HttpResponse::newHttpJsonResponse(val);
+	resp->setStatusCode(drogon::k200OK);
+	resp->addHeader("Access-Control-Allow-Origin", "*");
+	callback(resp);
+}
 
-void Nodes::getAllNodes(const drogon::HttpRequestPtr& req, DRCallback&& callback) {
+/**
+ * Per-route request counters, in-flight gauges and latency histograms as well as the time spent in each Phase, in the
+ * Prometheus text format.
+ */
+void Controller::getMetrics(const drogon::HttpRequestPtr& req, DRCallback&& callback) {
+	instrument(Route::Metrics, callback);
+	metrics::Gauges gauges;
+	if (responseCache != nullptr) {
+		auto stats = responseCache->stats();
+		gauges = {true, stats.hits, stats.misses, stats.entries, stats.charge};
+	}
+	gauges.workersQueued = workers->queued();
+	gauges.snapshotGeneration = snapshot()->generation;
+	gauges.snapshotsAlive = Snapshot::numAlive();
+	auto resp = drogon::HttpResponse::newHttpResponse();
+	resp->setStatusCode(drogon::k200OK);
+	resp->setContentTypeCodeAndCustomString(drogon::CT_TEXT_PLAIN, "text/plain; version=0.0.4; charset=utf-8");
+	resp->setBody(metrics::format(gauges));
+	callback(resp);
+}
+
+/**
+ * Starts a reload() of the graph and the landmarks and answers 202, or 409 if one is running already. Only accepted
+ * from the loopback interface. The response names the generation of the snapshot that is current at the time.
+ */
+void Controller::postReload(const drogon::HttpRequestPtr& req, DRCallback&& callback) {
+	instrument(Route::Reload, callback);
+	if (!req->peerAddr().isLoopbackIp()) {
+		auto resp = drogon::HttpResponse::newHttpResponse();
+		resp->setStatusCode(drogon::k403Forbidden);
+		callback(resp);
+		return;
+	}
+	const bool started = reload();
 	Json::Value val;
-	for (auto node : causenet.getConcepts())
-		val.append(node);
+	val["generation"] = (Json::UInt64)snapshot()->generation;
+	val["reloading"] = started;
 	auto resp = drogon::HttpResponse::newHttpJsonResponse(val);
+	resp->setStatusCode(started ? drogon::k202Accepted : drogon::k409Conflict);
+	callback(resp);
+}
+
+/** Joins the name of a route and its normalized parameters into a key of the response cache **/
+static std::string cacheKey(std::initializer_list<std::string_view> parts) {
+	std::string key;
+	for (auto part : parts) {
+		key.append(part);
+		key.push_back('\0');
+	}
+	return key;
+}
+
+/**
+ * @brief Replays the response cached for `key` on `snapshot` if there is one.
+ * @details Otherwise, `callback` is wrapped such that the response it is called with is cached if it is successful.
+ * Cached responses carry an `X-Cache: HIT` header, the others `X-Cache: MISS`.
+ * @returns true if the response was sent from the cache
+ */
+static bool respondFromCache(const Snapshot& snapshot, std::string key, DRCallback& callback) {
+	if (Controller::responseCache == nullptr)
+		return false;
+	// Responses of other snapshots are left to age out
+	key.insert(0, cacheKey({std::to_string(snapshot.generation)}));
+	if (auto hit = Controller::responseCache->get(key)) {
+		const auto& cached = **hit;
+		auto resp = drogon::HttpResponse::newHttpResponse();
+		resp->setStatusCode(drogon::k200OK);
+		resp->setContentTypeCode(cached.contentType);
+		resp->setBody(cached.body);
+		for (const auto& [name, value] : cached.headers)
+			resp->addHeader(name, value);
+		resp->addHeader("X-Cache", "HIT");
+		callback(resp);
+		return true;
+	}
+	callback = [key = std::move(key), callback = std::move(callback)](const drogon::HttpResponsePtr& resp) {
+		if (resp->statusCode() == drogon::k200OK) {
+			auto cached = std::make_shared<CachedResponse>();
+			cached->contentType = resp->contentType();
+			size_t charge = sizeof(CachedResponse) + key.size();
+			for (const auto& [name, value] : resp->headers()) {
+				cached->headers.emplace_back(name, value);
+				charge += name.size() + value.size();
+			}
+			// JSON responses are only serialized when they are sent
+			if (resp->body().empty() && resp->jsonObject() != nullptr) {
+				Json::StreamWriterBuilder builder;
+				builder["indentation"] = "";
+				cached->body = Json::writeString(builder, *resp->jsonObject());
+			} else {
+				cached->body = resp->body();
+			}
+			charge += cached->body.size();
+			Controller::responseCache->put(key, std::move(cached), charge);
+		}
+		resp->addHeader("X-Cache", "MISS");
+		callback(resp);
+	};
+	return false;
+}
+
+Nodes::Nodes() noexcept {
+	const auto& config = drogon::app().getCustomConfig()["path_search"];
+	maxPathDepth = config.get("max_depth", 32).asUInt();
+	maxExpandedNodes = config.get("max_expanded_nodes", 1000000).asUInt64();
+	maxPathTimeout = std::chrono::milliseconds(config.get("timeout_ms", 2000).asUInt64());
+	pathSearches.setCapacity(config.get("max_concurrent", 8).asUInt64());
+	defaultWeighting = causenet::EdgeWeighting::InverseSupport;
+	if (!causenet::parseEdgeWeighting(config.get("weighting", "inverse_support").asString(), defaultWeighting))
+		LOG_WARN << "Unknown path_search.weighting; falling back to inverse_support";
+	maxBatchOperations = drogon::app().getCustomConfig()["batch"].get("max_operations", 256).asUInt64();
+}
+
+static bool tryParseParameter(const drogon::HttpRequestPtr& req, const std::string& key, size_t& value) {
+	const auto& str = req->getParameter(key);
+	if (str.empty())
+		return true;
+	auto [ptr, ec] = std::from_chars(str.data(), str.data() + str.size(), value);
+	return ec == std::errc{} && ptr == str.data() + str.size();
+}
+
+/**
+ * Without parameters (or with `cursor` and `limit`), a page of at most `limit` concepts starting at index `cursor` is
+ * returned together with the cursor of the next page (`null` after the last page). With `all=true`, the complete list of
+ * concepts is streamed as a single JSON array.
+ */
+void Nodes::getAllNodes(const drogon::HttpRequestPtr& req, DRCallback&& callback) {
+	instrument(Route::AllNodes, callback);
+	const auto snapshot = Controller::snapshot();
+	const auto& causenet = snapshot->causenet;
+	if (req->getParameter("all") == "true") {
+		auto writer = std::make_shared<rest::json::ConceptArrayWriter>(causenet, 0, causenet.numConcepts());
+		auto resp = drogon::HttpResponse::newStreamResponse(
+				// The snapshot is kept until the last chunk is written
+				[writer, snapshot](char* buf, std::size_t size) -> std::size_t { return writer->fill(buf, size); },
+				"", drogon::CT_APPLICATION_JSON
+		);
+		resp->addHeader("Access-Control-Allow-Origin", "*");
+		callback(resp);
+		return;
+	}
+	size_t cursor = 0, limit = defaultPageSize;
+	if (!tryParseParameter(req, "cursor", cursor) || !tryParseParameter(req, "limit", limit) || limit == 0) {
+		auto resp = drogon::HttpResponse::newHttpResponse();
+		resp->setStatusCode(drogon::k400BadRequest);
+		callback(resp);
+		return;
+	}
+	cursor = std::min(cursor, causenet.numConcepts());
+	const size_t last = std::min(cursor + std::min(limit, maxPageSize), causenet.numConcepts());
+	auto body = metrics::timed(Phase::JSONSerialization, [&] {
+		std::string body = "{\"nodes\":";
+		rest::json::ConceptArrayWriter writer(causenet, cursor, last);
+		for (char buf[4096]; !writer.done();)
+			body.append(buf, writer.fill(buf, sizeof(buf)));
+		body += ",\"next\":";
+		body += (last < causenet.numConcepts()) ? std::to_string(last) : "null";
+		body += "}";
+		return body;
+	});
+	auto resp = drogon::HttpResponse::newHttpResponse();
 	resp->setStatusCode(drogon::k200OK);
+	resp->setContentTypeCode(drogon::CT_APPLICATION_JSON);
+	resp->setBody(std::move(body));
+	resp->addHeader("Access-Control-Allow-Origin", "*");
 	callback(resp);
 }
 
 void Nodes::getNode(const drogon::HttpRequestPtr& req, DRCallback&& callback, std::string nodeid) {
-	auto idx = causenet.getConceptIdx(nodeid);
+	instrument(Route::Node, callback);
+	const auto snapshot = Controller::snapshot();
+	const auto& causenet = snapshot->causenet;
+	if (respondFromCache(*snapshot, cacheKey({"node", nodeid}), callback))
+		return;
+	auto idx = metrics::timed(Phase::NameLookup, [&] { return causenet.getConceptIdx(nodeid); });
 	if (idx == -1) {
 		auto resp = drogon::HttpResponse::newHttpResponse();
 		resp->setStatusCode(drogon::k404NotFound);
@@ -53,10 +456,12 @@ void Nodes::getNode(const drogon::HttpRequestPtr& req, DRCallback&& callback, st
 		Json::Value val;
 		val["name"] = nodeid;
 		val["effects"] = Json::Value{};
-		for (auto&& [effect, cardinality] : causenet.getEffects(idx)) {
-			val["effects"].append(causenet.getConceptByIdx(effect));
-		}
-		auto resp = drogon::HttpResponse::newHttpJsonResponse(val);
+		metrics::timed(Phase::GraphTraversal, [&] {
+			for (auto&& [effect, cardinality] : causenet.getEffects(idx)) {
+				val["effects"].append(causenet.getConceptByIdx(effect));
+			}
+		});
+		auto resp = newJsonResponse(val);
 		resp->setStatusCode(drogon::k200OK);
 		resp->addHeader("Access-Control-Allow-Origin", "*");
 		callback(resp);
@@ -64,68 +469,409 @@ void Nodes::getNode(const drogon::HttpRequestPtr& req, DRCallback&& callback, st
 }
 
 void Nodes::getEffects(const drogon::HttpRequestPtr& req, DRCallback&& callback, std::string nodeid) {
-	auto idx = causenet.getConceptIdx(nodeid);
+	instrument(Route::Effects, callback);
+	const auto snapshot = Controller::snapshot();
+	const auto& causenet = snapshot->causenet;
+	if (respondFromCache(*snapshot, cacheKey({"effects", nodeid}), callback))
+		return;
+	auto idx = metrics::timed(Phase::NameLookup, [&] { return causenet.getConceptIdx(nodeid); });
 	if (idx == -1) {
 		auto resp = drogon::HttpResponse::newHttpResponse();
 		resp->setStatusCode(drogon::k404NotFound);
 		callback(resp);
 	} else {
 		Json::Value val;
-		for (auto&& [tgt, support] : causenet.getEffects(idx))
-			val.append(causenet.getConceptByIdx(tgt));
-		auto resp = drogon::HttpResponse::newHttpJsonResponse(val);
+		metrics::timed(Phase::GraphTraversal, [&] {
+			for (auto&& [tgt, support] : causenet.getEffects(idx))
+				val.append(causenet.getConceptByIdx(tgt));
+		});
+		auto resp = newJsonResponse(val);
 		resp->setStatusCode(drogon::k200OK);
 		resp->addHeader("Access-Control-Allow-Origin", "*");
 		callback(resp);
 	}
 }
+/**
+ * Returns the supports of the edge as an array. With `sourceType` (the numeric `sourceTypeId`), only the supports of
+ * that type are considered; `offset` and `limit` select a page of them. The number of supports matching `sourceType`
+ * is returned in the `X-Total-Count` header.
+ */
 void Nodes::getEffect(
 		const drogon::HttpRequestPtr& req, DRCallback&& callback, std::string nodeid, std::string targetid
 ) {
-	auto srcidx = causenet.getConceptIdx(nodeid);
-	auto dstidx = causenet.getConceptIdx(targetid);
+	instrument(Route::Effect, callback);
+	const auto snapshot = Controller::snapshot();
+	const auto& causenet = snapshot->causenet;
+	size_t offset = 0, limit = std::numeric_limits<size_t>::max(), sourceType = 0;
+	const bool filtered = !req->getParameter("sourceType").empty();
+	if (!tryParseParameter(req, "offset", offset) || !tryParseParameter(req, "limit", limit) ||
+		!tryParseParameter(req, "sourceType", sourceType) || sourceType >= causenet::numSourceTypes) {
+		auto resp = drogon::HttpResponse::newHttpResponse();
+		resp->setStatusCode(drogon::k400BadRequest);
+		callback(resp);
+		return;
+	}
+	auto key = cacheKey(
+			{"effect", nodeid, targetid, std::to_string(offset), std::to_string(limit),
+			 filtered ? std::to_string(sourceType) : ""}
+	);
+	if (respondFromCache(*snapshot, std::move(key), callback))
+		return;
+	auto [srcidx, dstidx] = metrics::timed(Phase::NameLookup, [&] {
+		return std::pair(causenet.getConceptIdx(nodeid), causenet.getConceptIdx(targetid));
+	});
 	if (srcidx == -1 || dstidx == -1) {
 		auto resp = drogon::HttpResponse::newHttpResponse();
 		resp->setStatusCode(drogon::k404NotFound);
 		callback(resp);
 	} else {
-		Json::Value val;
-		for (auto&& support : causenet.getSupport(srcidx, dstidx)) {
-			Json::Value dict;
-			dict["sourceTypeId"] = static_cast<std::uint8_t>(support.sourceTypeId);
-			dict["id"] = support.id;
-			dict["content"] = support.content;
-			val.append(dict);
-		}
-		auto resp = drogon::HttpResponse::newHttpJsonResponse(val);
+		auto type = static_cast<causenet::SourceType>(sourceType);
+		auto matching = metrics::timed(Phase::GraphTraversal, [&] {
+			return filtered ? causenet.getSupportViews(srcidx, dstidx, type) : causenet.getSupportViews(srcidx, dstidx);
+		});
+		auto supports = matching.slice(offset, limit);
+		std::string body;
+		// Files without stored lengths would need every support decoded twice to size the body up front
+		if (auto textSize = supports.textSize())
+			body.reserve(2 + *textSize + 48 * supports.size());
+		// The supports are decoded (and, if compressed, decompressed) straight into the body, so this is their decode
+		metrics::timed(Phase::SupportDecode, [&] { rest::json::appendSupports(body, supports); });
+		auto resp = drogon::HttpResponse::newHttpResponse();
 		resp->setStatusCode(drogon::k200OK);
+		resp->setContentTypeCode(drogon::CT_APPLICATION_JSON);
+		resp->setBody(std::move(body));
+		resp->addHeader("X-Total-Count", std::to_string(matching.size()));
 		resp->addHeader("Access-Control-Allow-Origin", "*");
+		resp->addHeader("Access-Control-Expose-Headers", "X-Total-Count");
 		callback(resp);
 	}
 }
 
-void Nodes::getPath(
-		const drogon::HttpRequestPtr& req, DRCallback&& callback, std::string nodeid, std::string targetid
-) {
-	auto start = causenet.getConceptIdx(nodeid);
-	auto target = causenet.getConceptIdx(targetid);
-	if (start == -1 || target == -1) {
+void Nodes::getCauses(const drogon::HttpRequestPtr& req, DRCallback&& callback, std::string nodeid) {
+	instrument(Route::Causes, callback);
+	const auto snapshot = Controller::snapshot();
+	const auto& causenet = snapshot->causenet;
+	if (respondFromCache(*snapshot, cacheKey({"causes", nodeid}), callback))
+		return;
+	auto idx = metrics::timed(Phase::NameLookup, [&] { return causenet.getConceptIdx(nodeid); });
+	if (idx == -1) {
 		auto resp = drogon::HttpResponse::newHttpResponse();
 		resp->setStatusCode(drogon::k404NotFound);
 		callback(resp);
 	} else {
-		auto neighborfn = std::bind(&Causenet::getEffects, std::cref(causenet), std::placeholders::_1);
 		Json::Value val;
-		val["path"] = Json::Value{};
-		for (const auto& node : utils::shortestPath(start, target, neighborfn))
-			val["path"].append(causenet.getConceptByIdx(node));
-		auto resp = drogon::HttpResponse::newHttpJsonResponse(val);
+		metrics::timed(Phase::GraphTraversal, [&] {
+			for (auto&& [src, support] : causenet.getCauses(idx))
+				val.append(causenet.getConceptByIdx(src));
+		});
+		auto resp = newJsonResponse(val);
 		resp->setStatusCode(drogon::k200OK);
 		resp->addHeader("Access-Control-Allow-Origin", "*");
 		callback(resp);
 	}
 }
 
+/**
+ * The search runs on Controller::workers with scratch arrays checked out of Nodes::pathSearches; requests beyond the
+ * limits of either are rejected with 503. It is bounded by `maxDepth`
+ * (edges of the path), `maxExpandedNodes` and `timeoutMs`, which default to and are capped at the server's limits. A
+ * search that exceeds one of them, or whose client disconnects, is stopped and answered with 422 naming the `limit`
+ * together with the work done so far. `weighting` selects the lengths of the edges (see causenet::EdgeWeighting) and
+ * defaults to `custom_config.path_search.weighting`. If landmarks were loaded for the same weighting (see
+ * Snapshot::landmarks), the search is A* guided by their bounds, which also answer most unreachable targets without
+ * any search.
+ */
+drogon::Task<>
+Nodes::getPath(drogon::HttpRequestPtr req, DRCallback callback, std::string nodeid, std::string targetid) {
+	instrument(Route::Path, callback);
+	const auto snapshot = Controller::snapshot();
+	const auto& causenet = snapshot->causenet;
+	const auto received = std::chrono::steady_clock::now();
+	size_t maxDepth = maxPathDepth, expansions = maxExpandedNodes, timeout = maxPathTimeout.count();
+	auto weighting = defaultWeighting;
+	if (!tryParseParameter(req, "maxDepth", maxDepth) || !tryParseParameter(req, "maxExpandedNodes", expansions) ||
+		!tryParseParameter(req, "timeoutMs", timeout) || maxDepth == 0 || expansions == 0 ||
+		(!req->getParameter("weighting").empty() &&
+		 !causenet::parseEdgeWeighting(req->getParameter("weighting"), weighting))) {
+		auto resp = drogon::HttpResponse::newHttpResponse();
+		resp->setStatusCode(drogon::k400BadRequest);
+		callback(resp);
+		co_return;
+	}
+	utils::PathSearchLimits limits;
+	limits.maxDepth = std::min<size_t>(maxDepth, maxPathDepth);
+	limits.maxExpandedNodes = std::min(expansions, maxExpandedNodes);
+	limits.deadline = received + std::min(std::chrono::milliseconds(timeout), maxPathTimeout);
+	limits.cancelled = [req] { return !req->connected(); };
+	// Only the weighting and the depth limit may change a path that is found
+	const auto depth = std::to_string(limits.maxDepth);
+	auto key = cacheKey({"path", nodeid, targetid, causenet::edgeWeightingName(weighting), depth});
+	if (respondFromCache(*snapshot, std::move(key), callback))
+		co_return;
+	auto [start, target] = metrics::timed(Phase::NameLookup, [&] {
+		return std::pair(causenet.getConceptIdx(nodeid), causenet.getConceptIdx(targetid));
+	});
+	if (start == -1 || target == -1) {
+		auto resp = drogon::HttpResponse::newHttpResponse();
+		resp->setStatusCode(drogon::k404NotFound);
+		callback(resp);
+		co_return;
+	}
+	auto permit = workerLimit(Route::Path).tryAcquire();
+	if (!permit || !co_await Controller::workers->schedule()) {
+		callback(newUnavailableResponse());
+		co_return;
+	}
+	// The scratch arrays are as large as the graph, so only a bounded number of them exist and are reused
+	auto search = pathSearches.tryAcquire();
+	if (!search) {
+		callback(newUnavailableResponse());
+		co_return;
+	}
+	// Precomputed lengths in the order of the edges; Hops has none
+	auto weight = [weights = causenet.edgeWeights(weighting)](std::uint64_t edge) -> std::uint64_t {
+		return weights.empty() ? 1 : weights[edge];
+	};
+	utils::PathSearchStats stats;
+	auto path = metrics::timed(Phase::GraphTraversal, [&] {
+		if (snapshot->landmarks != nullptr && snapshot->landmarks->header().weighting == weighting) {
+			auto bound = [&, bounds = snapshot->landmarks->bounds()](std::uint32_t node) {
+				return bounds.lowerBound(node, target);
+			};
+			return search->shortestPathAStar(causenet.effectGraph(), start, target, weight, bound, limits, stats);
+		}
+		return search->shortestPath(
+				causenet.effectGraph(), causenet.causeGraph(), start, target, weight, limits, stats);
+	});
+	using Outcome = utils::PathSearchStats::Outcome;
+	if (stats.outcome != Outcome::Found && stats.outcome != Outcome::Unreachable) {
+		static constexpr const char* names[] = {"", "", "maxDepth", "maxExpandedNodes", "timeoutMs", "cancelled"};
+		const auto elapsed = std::chrono::steady_clock::now() - received;
+		Json::Value val;
+		val["error"] = "limit exceeded";
+		val["limit"] = names[static_cast<int>(stats.outcome)];
+		val["stats"]["expandedNodes"] = (Json::UInt64)stats.expandedNodes;
+		val["stats"]["reachedNodes"] = (Json::UInt64)stats.reachedNodes;
+		val["stats"]["depth"] = stats.depth;
+		val["stats"]["elapsedMs"] = (Json::Int64)std::chrono::duration_cast<std::chrono::milliseconds>(elapsed).count();
+		auto resp = newJsonResponse(val);
+		resp->setStatusCode(drogon::k422UnprocessableEntity);
+		resp->addHeader("Access-Control-Allow-Origin", "*");
+		callback(resp);
+		co_return;
+	}
+	Json::Value val;
+	val["path"] = Json::Value{};
+	for (const auto& node : path)
+		val["path"].append(causenet.getConceptByIdx(node));
+	auto resp = newJsonResponse(val);
+	resp->setStatusCode(drogon::k200OK);
+	resp->addHeader("Access-Control-Allow-Origin", "*");
+	callback(resp);
+}
+
+namespace {
+	/** @brief One of the distinct operations of a batch (see Nodes::postBatch()) **/
+	struct BatchOperation {
+		enum class Kind { Node, Effects, Causes, Effect } kind;
+		size_t node = -1, target = -1; ///< -1 if the name is not a concept
+		size_t offset = 0, limit = std::numeric_limits<size_t>::max(), sourceType = 0;
+		bool filtered = false;
+		std::string result; ///< The JSON object in the `results` of the response
+	};
+
+	/** @brief State of a batch shared by the workers that run its operations; the last one to finish responds **/
+	struct Batch {
+		std::shared_ptr<const Snapshot> snapshot;
+		std::vector<BatchOperation> operations;
+		std::vector<size_t> slots; ///< The index in `operations` of each requested operation
+		std::atomic<size_t> next = 0; ///< The next operation to be claimed by a worker
+		std::atomic<size_t> running = 1;
+		utils::ConcurrencyLimit::Permit permit;
+		DRCallback callback;
+	};
+} // namespace
+
+/**
+ * Parses `{"op": "node"|"effects"|"causes"|"effect", "node": "...", "target": "..."}` with the optional `offset`,
+ * `limit` and `sourceType` of an `effect`.
+ * @returns false if the operation is malformed
+ */
+static bool tryParseOperation(const Json::Value& val, BatchOperation& op, std::string& node, std::string& target) {
+	using Kind = BatchOperation::Kind;
+	if (!val.isObject() || !val["op"].isString() || !val["node"].isString())
+		return false;
+	const auto name = val["op"].asString();
+	if (name == "node")
+		op.kind = Kind::Node;
+	else if (name == "effects")
+		op.kind = Kind::Effects;
+	else if (name == "causes")
+		op.kind = Kind::Causes;
+	else if (name == "effect")
+		op.kind = Kind::Effect;
+	else
+		return false;
+	node = val["node"].asString();
+	if (op.kind != Kind::Effect)
+		return true;
+	auto tryParse = [&val](const char* key, size_t& value) {
+		if (!val.isMember(key))
+			return true;
+		if (!val[key].isUInt64())
+			return false;
+		value = val[key].asUInt64();
+		return true;
+	};
+	if (!val["target"].isString() || !tryParse("offset", op.offset) || !tryParse("limit", op.limit) ||
+		!tryParse("sourceType", op.sourceType) || op.sourceType >= causenet::numSourceTypes)
+		return false;
+	op.filtered = val.isMember("sourceType");
+	target = val["target"].asString();
+	return true;
+}
+
+/** Serializes the result of `op` the same as the body of its route, wrapped into `{"status":...,"body":...}` **/
+static void runOperation(const Causenet& causenet, BatchOperation& op) {
+	using Kind = BatchOperation::Kind;
+	if (op.node == -1 || (op.kind == Kind::Effect && op.target == -1)) {
+		op.result = "{\"status\":404}";
+		return;
+	}
+	std::string& out = op.result;
+	if (op.kind == Kind::Effect) {
+		auto type = static_cast<causenet::SourceType>(op.sourceType);
+		auto matching = metrics::timed(Phase::GraphTraversal, [&] {
+			return op.filtered ? causenet.getSupportViews(op.node, op.target, type)
+							   : causenet.getSupportViews(op.node, op.target);
+		});
+		auto supports = matching.slice(op.offset, op.limit);
+		out = "{\"status\":200,\"total\":" + std::to_string(matching.size()) + ",\"body\":";
+		if (auto textSize = supports.textSize())
+			out.reserve(out.size() + 3 + *textSize + 48 * supports.size());
+		// Like in getEffect(), the supports are decoded straight into the result
+		metrics::timed(Phase::SupportDecode, [&] { rest::json::appendSupports(out, supports); });
+		out.push_back('}');
+		return;
+	}
+	Json::Value val;
+	metrics::timed(Phase::GraphTraversal, [&] {
+		if (op.kind == Kind::Node) {
+			val["name"] = causenet.getConceptByIdx(op.node);
+			val["effects"] = Json::Value{};
+			for (auto&& [effect, support] : causenet.getEffects(op.node))
+				val["effects"].append(causenet.getConceptByIdx(effect));
+		} else if (op.kind == Kind::Effects) {
+			for (auto&& [tgt, support] : causenet.getEffects(op.node))
+				val.append(causenet.getConceptByIdx(tgt));
+		} else {
+			for (auto&& [src, support] : causenet.getCauses(op.node))
+				val.append(causenet.getConceptByIdx(src));
+		}
+	});
+	metrics::timed(Phase::JSONSerialization, [&] {
+		static const auto builder = [] {
+			Json::StreamWriterBuilder builder;
+			builder["indentation"] = "";
+			return builder;
+		}();
+		out = "{\"status\":200,\"body\":" + Json::writeString(builder, val) + "}";
+	});
+}
+
+/** Claims and runs operations of `batch` until none are left; the last worker to return sends the response **/
+static void runBatch(const std::shared_ptr<Batch>& batch) {
+	const auto& causenet = batch->snapshot->causenet;
+	for (size_t i; (i = batch->next.fetch_add(1)) < batch->operations.size();)
+		runOperation(causenet, batch->operations[i]);
+	if (batch->running.fetch_sub(1) != 1)
+		return;
+	std::string body = "{\"results\":[";
+	for (size_t i = 0; i < batch->slots.size(); ++i) {
+		if (i > 0)
+			body.push_back(',');
+		body += batch->operations[batch->slots[i]].result;
+	}
+	body += "]}";
+	auto resp = drogon::HttpResponse::newHttpResponse();
+	resp->setStatusCode(drogon::k200OK);
+	resp->setContentTypeCode(drogon::CT_APPLICATION_JSON);
+	resp->setBody(std::move(body));
+	resp->addHeader("Access-Control-Allow-Origin", "*");
+	batch->callback(resp);
+}
+
+/**
+ * Answers `{"operations": [...]}` (see tryParseOperation()) with `{"results": [...]}` in the same order, each result
+ * being `{"status": 200, "body": ...}` with the body of the corresponding route (`effect` adds the `total` of its
+ * `X-Total-Count`) or `{"status": 404}` for an unknown concept. Every distinct name is looked up once and duplicate
+ * operations are run once. The operations are spread over Controller::workers; batches beyond its limits or
+ * `custom_config.batch.max_operations` are rejected with 503 and 400, respectively.
+ */
+drogon::Task<> Nodes::postBatch(drogon::HttpRequestPtr req, DRCallback callback) {
+	instrument(Route::Batch, callback);
+	auto badRequest = [&callback] {
+		auto resp = drogon::HttpResponse::newHttpResponse();
+		resp->setStatusCode(drogon::k400BadRequest);
+		callback(resp);
+	};
+	const auto json = req->getJsonObject();
+	if (json == nullptr || !json->isObject() || !(*json)["operations"].isArray() ||
+		(*json)["operations"].size() > maxBatchOperations) {
+		badRequest();
+		co_return;
+	}
+	auto batch = std::make_shared<Batch>();
+	batch->snapshot = Controller::snapshot();
+	const auto& causenet = batch->snapshot->causenet;
+	std::unordered_map<std::string, size_t> concepts, operations;
+	auto conceptIdx = [&](std::string name) {
+		auto [it, inserted] = concepts.try_emplace(std::move(name), -1);
+		if (inserted)
+			it->second = causenet.getConceptIdx(it->first);
+		return it->second;
+	};
+	bool valid = true;
+	metrics::timed(Phase::NameLookup, [&] {
+		for (const auto& val : (*json)["operations"]) {
+			BatchOperation op;
+			std::string node, target;
+			if (!(valid = tryParseOperation(val, op, node, target)))
+				return;
+			auto key = cacheKey(
+					{std::to_string(static_cast<int>(op.kind)), node, target, std::to_string(op.offset),
+					 std::to_string(op.limit), op.filtered ? std::to_string(op.sourceType) : ""}
+			);
+			auto [it, inserted] = operations.try_emplace(std::move(key), batch->operations.size());
+			if (inserted) {
+				op.node = conceptIdx(std::move(node));
+				if (op.kind == BatchOperation::Kind::Effect)
+					op.target = conceptIdx(std::move(target));
+				batch->operations.push_back(std::move(op));
+			}
+			batch->slots.push_back(it->second);
+		}
+	});
+	if (!valid) {
+		badRequest();
+		co_return;
+	}
+	batch->permit = workerLimit(Route::Batch).tryAcquire();
+	if (!batch->permit || !co_await Controller::workers->schedule()) {
+		callback(newUnavailableResponse());
+		co_return;
+	}
+	batch->callback = std::move(callback);
+	// Helpers that the pool rejects leave their share to the others
+	const auto numWorkers = std::min(Controller::workers->size(), batch->operations.size());
+	for (size_t i = 1; i < numWorkers; ++i) {
+		batch->running.fetch_add(1);
+		if (!Controller::workers->tryPost([batch] { runBatch(batch); }))
+			batch->running.fetch_sub(1);
+	}
+	runBatch(batch);
+}
+
 static bool tryGetPath(const std::string& id, const std::filesystem::path& base, std::filesystem::path& path) {
 	static std::regex idregex("^clueweb12-(\\d{4}\\w{2})-(\\d{2})-(\\d{5})$");
 	std::smatch match;
@@ -136,10 +882,26 @@ static bool tryGetPath(const std::string& id, const std::filesystem::path& base,
 	return true;
 }
 
-static bool tryGetRecordByID(const std::string& id, warc::v1::WARCRecord& record) {
+std::unique_ptr<warc::v1::WARCIndex> ClueWeb12::index;
+std::filesystem::path ClueWeb12::partsDir;
+
+ClueWeb12::ClueWeb12() noexcept {
+	ClueWeb12::partsDir = drogon::app().getCustomConfig().get("clueweb_dir", "/mnt/clueweb12/parts").asString();
+	ClueWeb12::index = warc::v1::WARCIndex::open(std::filesystem::current_path() / ".data" / "clueweb12.warcidx");
+	if (index)
+		LOG_INFO << "Loaded ClueWeb12 index with " << index->header().numEntries << " records";
+	else
+		LOG_INFO << "No ClueWeb12 index found; records are looked up by scanning their segment";
+}
+
+static bool readRecordByID(const std::string& id, warc::v1::WARCRecord& record) {
 	std::filesystem::path path;
-	if (!tryGetPath(id, "/mnt/clueweb12/parts", path))
+	if (!tryGetPath(id, ClueWeb12::partsDir, path))
 		return false;
+	if (ClueWeb12::index) {
+		if (auto entry = ClueWeb12::index->find(id); entry != nullptr)
+			return ClueWeb12::index->readRecord(*entry, path, record) && record.entries["WARC-TREC-ID"] == id;
+	}
 	std::ifstream file(path.c_str());
 	if (!file.good())
 		return false;
@@ -153,11 +915,17 @@ static bool tryGetRecordByID(const std::string& id, warc::v1::WARCRecord& record
 	return false;
 }
 
-static std::string loadClueWeb12Entry(const std::string& id) {
+static bool tryGetRecordByID(const std::string& id, warc::v1::WARCRecord& record) {
+	return metrics::timed(Phase::WARCDecompression, [&] { return readRecordByID(id, record); });
+}
+
+/** @returns the HTTP body of the record, or std::nullopt if it is not indexed or cannot be read **/
+static std::optional<std::string> loadClueWeb12Entry(const std::string& id) {
 	warc::v1::WARCRecord record;
-	assert(tryGetRecordByID(id, record));
+	if (!tryGetRecordByID(id, record))
+		return std::nullopt;
 	auto start = record.content.find("\n\r\n");
-	return record.content.substr(start);
+	return (start == std::string::npos) ? std::string{} : record.content.substr(start);
 }
 
 static std::string redactURLs(std::string text) {
@@ -166,25 +934,48 @@ static std::string redactURLs(std::string text) {
 	return std::regex_replace(text, urlregex, "about:blank");
 }
 
-void ClueWeb12::getEntryContent(const drogon::HttpRequestPtr& req, DRCallback&& callback, std::string pageid) {
+/**
+ * Decompression and redaction run on Controller::workers; requests beyond its limits are rejected with 503. A page
+ * that is not indexed or cannot be read is answered with 404.
+ */
+drogon::Task<> ClueWeb12::getEntryContent(drogon::HttpRequestPtr req, DRCallback callback, std::string pageid) {
+	instrument(Route::ClueWebContent, callback);
+	auto permit = workerLimit(Route::ClueWebContent).tryAcquire();
+	if (!permit || !co_await Controller::workers->schedule()) {
+		callback(newUnavailableResponse());
+		co_return;
+	}
+	auto content = loadClueWeb12Entry(pageid);
 	auto resp = drogon::HttpResponse::newHttpResponse();
-	resp->setBody(redactURLs(loadClueWeb12Entry(pageid)));
+	if (!content) {
+		resp->setStatusCode(drogon::k404NotFound);
+		callback(resp);
+		co_return;
+	}
+	resp->setBody(redactURLs(std::move(*content)));
 	resp->addHeader("Access-Control-Allow-Origin", "*");
 	callback(resp);
 }
 
-void ClueWeb12::getEntryInfo(const drogon::HttpRequestPtr& req, DRCallback&& callback, std::string pageid) {
+/** Like getEntryContent(), the record is decompressed on Controller::workers **/
+drogon::Task<> ClueWeb12::getEntryInfo(drogon::HttpRequestPtr req, DRCallback callback, std::string pageid) {
+	instrument(Route::ClueWebInfo, callback);
+	auto permit = workerLimit(Route::ClueWebInfo).tryAcquire();
+	if (!permit || !co_await Controller::workers->schedule()) {
+		callback(newUnavailableResponse());
+		co_return;
+	}
 	warc::v1::WARCRecord record;
 	if (!tryGetRecordByID(pageid, record)) {
 		auto resp = drogon::HttpResponse::newHttpResponse();
 		resp->setStatusCode(drogon::k404NotFound);
 		callback(resp);
-		return;
+		co_return;
 	}
 	Json::Value val;
 	for (auto&& [key, value] : record.entries)
 		val[key] = value;
-	auto resp = drogon::HttpResponse::newHttpJsonResponse(val);
+	auto resp = newJsonResponse(val);
 	resp->setStatusCode(drogon::k200OK);
 	resp->addHeader("Access-Control-Allow-Origin", "*");
 	callback(resp);
@@ -0,0 +1,153 @@
+#ifndef CAUSENET_REST_JSON_HPP
+#define CAUSENET_REST_JSON_HPP
+
+#include <causenet/causenet.hpp>
+
+#include <algorithm>
+#include <concepts>
+#include <cstring>
+#include <ranges>
+#include <string>
+#include <string_view>
+
+namespace causenet::rest::json {
+	/** @returns the escape sequence for c or an empty view if c can be written as is **/
+	inline std::string_view escape(char c, char (&buf)[7]) noexcept {
+		switch (c) {
+		case '"':
+			return "\\\"";
+		case '\\':
+			return "\\\\";
+		case '\n':
+			return "\\n";
+		case '\r':
+			return "\\r";
+		case '\t':
+			return "\\t";
+		default:
+			if (static_cast<unsigned char>(c) >= 0x20)
+				return {};
+			static constexpr char hex[] = "0123456789abcdef";
+			buf[0] = '\\';
+			buf[1] = 'u';
+			buf[2] = buf[3] = '0';
+			buf[4] = hex[(c >> 4) & 0xf];
+			buf[5] = hex[c & 0xf];
+			return {buf, 6};
+		}
+	}
+
+	/** Appends `"str"` with the necessary characters escaped **/
+	inline void appendString(std::string& out, std::string_view str) {
+		char buf[7];
+		out.push_back('"');
+		for (char c : str) {
+			if (auto esc = escape(c, buf); esc.empty())
+				out.push_back(c);
+			else
+				out.append(esc);
+		}
+		out.push_back('"');
+	}
+
+	/**
+	 * @brief Appends `[{"sourceTypeId":...,"id":"...","content":"..."},...]`, copying the strings straight from the views.
+	 */
+	template <std::ranges::input_range R>
+		requires std::same_as<std::ranges::range_value_t<R>, SupportView>
+	inline void appendSupports(std::string& out, R&& supports) {
+		out.push_back('[');
+		bool first = true;
+		for (SupportView support : supports) {
+			out += first ? "{\"sourceTypeId\":" : ",{\"sourceTypeId\":";
+			first = false;
+			out += std::to_string(static_cast<unsigned>(support.sourceTypeId));
+			out += ",\"id\":";
+			appendString(out, support.id);
+			out += ",\"content\":";
+			appendString(out, support.content);
+			out.push_back('}');
+		}
+		out.push_back(']');
+	}
+
+	/**
+	 * @brief Writes the JSON array `["name_first", ..., "name_last-1"]` of concept names in chunks of arbitrary size.
+	 * @details The names are copied (and escaped) straight from the mapped file and only the current position is kept
+	 * such that the document never has to be held in memory. Meant to back drogon's stream responses.
+	 */
+	class ConceptArrayWriter final {
+	private:
+		enum class State { Start, NextItem, InName, End };
+
+		const Causenet& causenet;
+		const size_t begin;
+		size_t idx;
+		const size_t last;
+		State state = State::Start;
+		std::string_view current;
+		size_t pos = 0;
+		char escapeBuf[7];
+		std::string_view pending; ///< Tokens that still have to be written before continuing
+
+	public:
+		ConceptArrayWriter(const Causenet& causenet, size_t first, size_t last) noexcept
+				: causenet(causenet), begin(first), idx(first), last(last) {}
+
+		bool done() const noexcept { return state == State::End && pending.empty(); }
+
+		/** @returns the number of bytes written to buf; 0 once the array is complete **/
+		size_t fill(char* buf, size_t size) noexcept {
+			size_t out = 0;
+			while (out < size) {
+				if (!pending.empty()) {
+					auto n = std::min(size - out, pending.size());
+					std::memcpy(buf + out, pending.data(), n);
+					pending.remove_prefix(n);
+					out += n;
+					continue;
+				}
+				switch (state) {
+				case State::Start:
+					pending = "[";
+					state = State::NextItem;
+					break;
+				case State::NextItem:
+					if (idx >= last) {
+						pending = "]";
+						state = State::End;
+					} else {
+						current = causenet.getConceptName(idx);
+						pos = 0;
+						pending = (idx == begin) ? "\"" : ",\"";
+						state = State::InName;
+					}
+					break;
+				case State::InName:
+					if (pos == current.size()) {
+						pending = "\"";
+						++idx;
+						state = State::NextItem;
+					} else if (auto esc = escape(current[pos], escapeBuf); !esc.empty()) {
+						pending = esc;
+						++pos;
+					} else {
+						// Copy the longest run that needs no escaping directly from the mapped name
+						auto run = pos;
+						while (run < current.size() && run - pos < size - out && escape(current[run], escapeBuf).empty())
+							++run;
+						std::memcpy(buf + out, current.data() + pos, run - pos);
+						out += run - pos;
+						pos = run;
+					}
+					break;
+				case State::End:
+					return out;
+				}
+			}
+			return out;
+		}
+	};
+} // namespace causenet::rest::json
+
+#endif
\ No newline at end of file
@@ -0,0 +1,210 @@
+#ifndef CAUSENET_REST_METRICS_HPP
+#define CAUSENET_REST_METRICS_HPP
+
+#include <utils/thread_counters.hpp>
+
+#include <algorithm>
+#include <array>
+#include <bit>
+#include <charconv>
+#include <chrono>
+#include <cinttypes>
+#include <cmath>
+#include <string>
+#include <string_view>
+
+/**
+ * Request metrics of the REST API in the Prometheus text format (see Controller::getMetrics()). Every counter lives in
+ * a utils::ThreadCounters such that recording never synchronizes the handler threads.
+ */
+namespace causenet::rest::metrics {
+	using Clock = std::chrono::steady_clock;
+
+	enum class Route : unsigned {
+		Index,
+		CacheStats,
+		Metrics,
+		Reload,
+		AllNodes,
+		Node,
+		Effects,
+		Effect,
+		Causes,
+		Path,
+		Batch,
+		ClueWebContent,
+		ClueWebInfo
+	};
+	static constexpr std::array<std::string_view, 13> routeNames = {
+			"/",
+			"/v1/cache",
+			"/metrics",
+			"/admin/reload",
+			"/v1/nodes",
+			"/v1/nodes/{nodeid}",
+			"/v1/nodes/{nodeid}/effects",
+			"/v1/nodes/{nodeid}/effects/{targetid}",
+			"/v1/nodes/{nodeid}/causes",
+			"/v1/nodes/{nodeid}/path-to/{targetid}",
+			"/v1/batch",
+			"/v1/clueweb/{pageid}/content",
+			"/v1/clueweb/{pageid}/info"
+	};
+	static constexpr size_t numRoutes = routeNames.size();
+
+	/** @brief The main phases of handling a request, which are timed independently of the route **/
+	enum class Phase : unsigned { NameLookup, GraphTraversal, SupportDecode, WARCDecompression, JSONSerialization };
+	static constexpr std::array<std::string_view, 5> phaseNames = {
+			"name_lookup", "graph_traversal", "support_decode", "warc_decompression", "json_serialization"
+	};
+	static constexpr size_t numPhases = phaseNames.size();
+
+	/** Bucket i < numBuckets - 1 counts durations below 2^i microseconds, the last one all others (`+Inf`) **/
+	static constexpr size_t numBuckets = 25;
+	inline size_t bucketOf(std::uint64_t nanoseconds) noexcept {
+		return std::min<size_t>(std::bit_width(nanoseconds / 1000), numBuckets - 1);
+	}
+
+	/** @brief Offsets of the counters within the ThreadCounters **/
+	namespace layout {
+		static constexpr size_t numStatusClasses = 5; ///< 1xx to 5xx
+		static constexpr size_t histogram = numBuckets + 1; ///< The buckets followed by the sum of nanoseconds
+		static constexpr size_t started = 0;
+		static constexpr size_t finished = 1;
+		static constexpr size_t status = 2;
+		static constexpr size_t latency = status + numStatusClasses;
+		static constexpr size_t perRoute = latency + histogram;
+		static constexpr size_t phases = numRoutes * perRoute;
+		static constexpr size_t size = phases + numPhases * histogram;
+
+		constexpr size_t route(Route route) noexcept { return static_cast<size_t>(route) * perRoute; }
+		constexpr size_t phase(Phase phase) noexcept { return phases + static_cast<size_t>(phase) * histogram; }
+	} // namespace layout
+
+	inline utils::ThreadCounters<layout::size> counters;
+
+	inline void addToHistogram(size_t offset, std::uint64_t nanoseconds) {
+		counters.add(offset + bucketOf(nanoseconds));
+		counters.add(offset + numBuckets, nanoseconds);
+	}
+
+	inline void requestStarted(Route route) { counters.add(layout::route(route) + layout::started); }
+
+	inline void requestFinished(Route route, unsigned status, Clock::duration latency) {
+		const auto base = layout::route(route);
+		counters.add(base + layout::finished);
+		counters.add(base + layout::status + std::clamp(status / 100, 1u, 5u) - 1);
+		addToHistogram(base + layout::latency, std::chrono::duration_cast<std::chrono::nanoseconds>(latency).count());
+	}
+
+	/** @returns `f()` after adding the time it took to `phase` **/
+	template <typename F>
+	inline decltype(auto) timed(Phase phase, F&& f) {
+		struct Timer {
+			Phase phase;
+			Clock::time_point start = Clock::now();
+			~Timer() {
+				auto duration = std::chrono::duration_cast<std::chrono::nanoseconds>(Clock::now() - start);
+				addToHistogram(layout::phase(phase), duration.count());
+			}
+		} timer{phase};
+		return f();
+	}
+
+	/** @brief Values that are not counted by the handlers but read when the metrics are requested **/
+	struct Gauges {
+		bool responseCache = false;
+		std::uint64_t cacheHits = 0;
+		std::uint64_t cacheMisses = 0;
+		size_t cacheEntries = 0;
+		size_t cacheBytes = 0;
+		size_t workersQueued = 0;
+		std::uint64_t snapshotGeneration = 0;
+		size_t snapshotsAlive = 0; ///< Includes the replaced snapshots that unfinished requests still hold
+	};
+
+	/** @returns all metrics in the Prometheus text exposition format (version 0.0.4) **/
+	inline std::string format(const Gauges& gauges) {
+		const auto values = counters.snapshot();
+		std::string out;
+		auto number = [&out](auto value) {
+			char buf[32];
+			out.append(buf, std::to_chars(buf, buf + sizeof(buf), value).ptr);
+		};
+		auto header = [&out](std::string_view name, std::string_view type, std::string_view help) {
+			out.append("# HELP ").append(name).append(" ").append(help).append("\n");
+			out.append("# TYPE ").append(name).append(" ").append(type).append("\n");
+		};
+		auto sample = [&](std::string_view name, std::string_view labels, auto value) {
+			out += name;
+			if (!labels.empty())
+				out.append("{").append(labels).append("}");
+			out += ' ';
+			number(value);
+			out += '\n';
+		};
+		auto histogram = [&](std::string_view name, const std::string& labels, size_t offset) {
+			std::uint64_t cumulative = 0;
+			for (size_t i = 0; i < numBuckets; ++i) {
+				cumulative += values[offset + i];
+				std::string le = labels + ",le=\"";
+				if (i + 1 < numBuckets) {
+					char buf[32];
+					le.append(buf, std::to_chars(buf, buf + sizeof(buf), std::ldexp(1e-6, i)).ptr);
+				} else {
+					le += "+Inf";
+				}
+				sample(std::string(name) + "_bucket", le + "\"", cumulative);
+			}
+			sample(std::string(name) + "_sum", labels, values[offset + numBuckets] / 1e9);
+			sample(std::string(name) + "_count", labels, cumulative);
+		};
+		auto routeLabel = [](size_t r) { return "route=\"" + std::string(routeNames[r]) + "\""; };
+
+		header("causenet_http_requests_total", "counter", "Completed requests by route and status class.");
+		for (size_t r = 0; r < numRoutes; ++r) {
+			for (size_t c = 0; c < layout::numStatusClasses; ++c) {
+				if (auto count = values[r * layout::perRoute + layout::status + c]; count > 0) {
+					auto labels = routeLabel(r) + ",status=\"" + std::to_string(c + 1) + "xx\"";
+					sample("causenet_http_requests_total", labels, count);
+				}
+			}
+		}
+		header("causenet_http_requests_in_flight", "gauge", "Requests that are being handled by route.");
+		for (size_t r = 0; r < numRoutes; ++r) {
+			const auto started = values[r * layout::perRoute + layout::started];
+			const auto finished = values[r * layout::perRoute + layout::finished];
+			// The blocks are summed one after the other, so a request may be seen finished but not started
+			sample("causenet_http_requests_in_flight", routeLabel(r), started - std::min(started, finished));
+		}
+		header("causenet_http_request_duration_seconds", "histogram", "Time until the response was handed over.");
+		for (size_t r = 0; r < numRoutes; ++r)
+			histogram("causenet_http_request_duration_seconds", routeLabel(r), r * layout::perRoute + layout::latency);
+		header("causenet_phase_duration_seconds", "histogram", "Time spent in the main phases of the requests.");
+		for (size_t p = 0; p < numPhases; ++p) {
+			histogram(
+					"causenet_phase_duration_seconds", "phase=\"" + std::string(phaseNames[p]) + "\"",
+					layout::phase(static_cast<Phase>(p))
+			);
+		}
+		header("causenet_worker_queue_depth", "gauge", "Requests that wait for a worker.");
+		sample("causenet_worker_queue_depth", "", gauges.workersQueued);
+		header("causenet_snapshot_generation", "gauge", "Reloads of the graph since the start.");
+		sample("causenet_snapshot_generation", "", gauges.snapshotGeneration);
+		header("causenet_snapshots_alive", "gauge", "Loaded graphs, including replaced ones still used by requests.");
+		sample("causenet_snapshots_alive", "", gauges.snapshotsAlive);
+		if (gauges.responseCache) {
+			header("causenet_response_cache_hits_total", "counter", "Responses replayed from the response cache.");
+			sample("causenet_response_cache_hits_total", "", gauges.cacheHits);
+			header("causenet_response_cache_misses_total", "counter", "Lookups that missed the response cache.");
+			sample("causenet_response_cache_misses_total", "", gauges.cacheMisses);
+			header("causenet_response_cache_entries", "gauge", "Responses in the response cache.");
+			sample("causenet_response_cache_entries", "", gauges.cacheEntries);
+			header("causenet_response_cache_bytes", "gauge", "Approximate size of the cached responses.");
+			sample("causenet_response_cache_bytes", "", gauges.cacheBytes);
+		}
+		return out;
+	}
+} // namespace causenet::rest::metrics
+
+#endif
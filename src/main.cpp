@@ -74,12 +74,13 @@ int main() {
 
 #include <causenet/rest/controller_v1.hpp>
 
-int main() {
+/** `causenetexe [config.yml]`; the config file defaults to `config.dev.yml` in the working directory **/
+int main(int argc, char* argv[]) {
 	drogon::app().setLogLevel(trantor::Logger::LogLevel::kTrace);
-	// Set HTTP listener address and port
-	drogon::app().addListener("0.0.0.0", 8432);
 	// Load config file
-	drogon::app().loadConfigFile("config.dev.yml");
+	drogon::app().loadConfigFile(argc > 1 ? argv[1] : "config.dev.yml");
+	// Set HTTP listener address and port
+	drogon::app().addListener("0.0.0.0", drogon::app().getCustomConfig().get("port", 8432).asUInt());
 	// Run HTTP framework,the method will block in the internal event loop
 	drogon::app().run();
 	return 0;
@@ -0,0 +1,58 @@
+#include <causenet/causenet.hpp>
+
+#include <iostream>
+#include <string>
+
+/** @returns the number of bytes of e.g. "512M" or "4G" **/
+static size_t parseSize(const std::string& str) {
+	size_t pos;
+	size_t size = std::stoull(str, &pos);
+	switch (pos < str.size() ? str[pos] : '\0') {
+	case 'G':
+		size <<= 10;
+		[[fallthrough]];
+	case 'M':
+		size <<= 10;
+		[[fallthrough]];
+	case 'K':
+		size <<= 10;
+	}
+	return size;
+}
+
+/**
+ * Converts the CauseNet JSONL dump into the binary format served by causenetexe, e.g.:
+ * `causenet_convert .data/causenet-full.jsonl .data/causenet-full-supported-reworked.causenet --memory 4G`
+ * ClueWeb12 page ids are translated using `rec-to-trec-id.txt` from the working directory. With `--memory`, the
+ * supports and edges are sorted externally within the given budget; the temporary files are placed next to the output.
+ * With `--compress`, the support sentences are stored zstd-compressed and only decompressed on demand. `--order`
+ * renumbers the concepts such that neighbors are stored together (see utils::NodeOrdering), which speeds up traversals.
+ */
+int main(int argc, char* argv[]) {
+	unsigned numThreads = std::thread::hardware_concurrency();
+	size_t memoryLimit = 0;
+	bool compressSupports = false;
+	auto ordering = utils::NodeOrdering::Input;
+	bool valid = argc >= 3;
+	for (int i = 3; valid && i < argc; ++i) {
+		std::string arg = argv[i];
+		if (arg == "--compress")
+			compressSupports = true;
+		else if (arg == "--threads" && i + 1 < argc)
+			numThreads = std::stoul(argv[++i]);
+		else if (arg == "--memory" && i + 1 < argc)
+			memoryLimit = parseSize(argv[++i]);
+		else if (arg == "--order" && i + 1 < argc)
+			valid = utils::parseNodeOrdering(argv[++i], ordering);
+		else
+			valid = false;
+	}
+	if (!valid) {
+		std::cerr << "Usage: " << argv[0]
+				  << " <input.jsonl> <output.causenet> [--threads <n>] [--memory <bytes>[K|M|G]] [--compress]"
+				  << " [--order input|degree|bfs|rcm]" << std::endl;
+		return 1;
+	}
+	causenet::Causenet::jsonlToBinary(argv[1], argv[2], numThreads, memoryLimit, compressSupports, ordering);
+	return 0;
+}
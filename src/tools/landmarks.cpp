@@ -0,0 +1,60 @@
+#include <causenet/causenet.hpp>
+#include <causenet/landmarks.hpp>
+
+#include <iostream>
+#include <stdexcept>
+#include <string>
+
+/**
+ * Precomputes the landmark distances that speed up the path searches of causenetexe, e.g.:
+ * `causenet_landmarks .data/causenet-full-supported-reworked.causenet .data/causenet.landmarks --landmarks 16`
+ * `--select degree` takes the concepts with the most edges as landmarks, `--select farthest` (the default) spreads
+ * them over the graph. The distances only help the path searches with the same `--weighting` (by default
+ * `inverse_support`). Each landmark costs `8 * numConcepts` bytes.
+ */
+int main(int argc, char* argv[]) {
+	unsigned numThreads = std::thread::hardware_concurrency();
+	size_t numLandmarks = 16;
+	auto selection = utils::LandmarkSelection::Farthest;
+	auto weighting = causenet::EdgeWeighting::InverseSupport;
+	bool valid = argc >= 3;
+	try {
+		for (int i = 3; valid && i < argc; ++i) {
+			std::string arg = argv[i];
+			if (arg == "--threads" && i + 1 < argc)
+				numThreads = std::stoul(argv[++i]);
+			else if (arg == "--landmarks" && i + 1 < argc)
+				numLandmarks = std::stoul(argv[++i]);
+			else if (arg == "--select" && i + 1 < argc) {
+				std::string value = argv[++i];
+				if (value == "degree")
+					selection = utils::LandmarkSelection::Degree;
+				else if (value == "farthest")
+					selection = utils::LandmarkSelection::Farthest;
+				else
+					valid = false;
+			} else if (arg == "--weighting" && i + 1 < argc)
+				valid = causenet::parseEdgeWeighting(argv[++i], weighting);
+			else
+				valid = false;
+		}
+	} catch (const std::logic_error&) {
+		// std::stoul() rejects numbers that are malformed or out of range
+		valid = false;
+	}
+	if (!valid || numLandmarks == 0) {
+		std::cerr << "Usage: " << argv[0]
+				  << " <input.causenet> <output.landmarks> [--landmarks <n>] [--select degree|farthest]"
+				  << " [--weighting hops|inverse_support|neg_log_confidence|source_type] [--threads <n>]"
+				  << std::endl;
+		return 1;
+	}
+	try {
+		auto causenet = causenet::Causenet::fromFile(argv[1]);
+		causenet::LandmarkIndex::build(causenet, argv[2], numLandmarks, selection, weighting, numThreads);
+	} catch (const std::exception& e) {
+		std::cerr << e.what() << std::endl;
+		return 1;
+	}
+	return 0;
+}
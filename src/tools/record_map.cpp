@@ -0,0 +1,23 @@
+#include <warc_index.hpp>
+
+#include <iostream>
+
+/**
+ * Compiles the mapping from WARC-Record-IDs to TREC-IDs that the converter uses for ClueWeb12 sources, e.g.:
+ * `causenet_recordmap rec-to-trec-id.txt rec-to-trec-id.bin`
+ */
+int main(int argc, char* argv[]) {
+	if (argc != 3) {
+		std::cerr << "Usage: " << argv[0] << " <rec-to-trec-id.txt> <output map>" << std::endl;
+		return 1;
+	}
+	try {
+		auto skipped = warc::v1::buildRecordMap(argv[1], argv[2]);
+		if (skipped > 0)
+			std::cerr << "Skipped " << skipped << " malformed lines" << std::endl;
+	} catch (const std::exception& e) {
+		std::cerr << e.what() << std::endl;
+		return 1;
+	}
+	return 0;
+}
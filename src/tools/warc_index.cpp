@@ -0,0 +1,16 @@
+#include <warc_index.hpp>
+
+#include <iostream>
+
+/**
+ * Builds the index that lets the server seek directly to a ClueWeb12 record instead of decompressing the whole
+ * segment, e.g.: `causenet_warcindex /mnt/clueweb12/parts .data/clueweb12.warcidx`
+ */
+int main(int argc, char* argv[]) {
+	if (argc != 3) {
+		std::cerr << "Usage: " << argv[0] << " <ClueWeb12 parts directory> <output index>" << std::endl;
+		return 1;
+	}
+	warc::v1::buildIndex(argv[1], argv[2]);
+	return 0;
+}
\ No newline at end of file
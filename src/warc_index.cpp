@@ -0,0 +1,523 @@
+#include <warc_index.hpp>
+
+#include <zlib.h>
+
+#include <algorithm>
+#include <array>
+#include <cassert>
+#include <cstring>
+#include <format>
+#include <fstream>
+#include <iostream>
+#include <optional>
+#include <sstream>
+#include <stdexcept>
+#include <streambuf>
+#include <vector>
+
+// Linux only headers :(
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <unistd.h>
+
+using namespace warc::v1;
+namespace fs = std::filesystem;
+
+bool warc::v1::parseTrecId(std::string_view id, IndexEntry& key) noexcept {
+	// clueweb12-0000tw-00-00042
+	static constexpr std::string_view prefix = "clueweb12-";
+	if (id.size() != prefix.size() + 15 || !id.starts_with(prefix) || id[16] != '-' || id[19] != '-')
+		return false;
+	std::memcpy(key.segment, id.data() + 10, 6);
+	std::memcpy(key.segment + 6, id.data() + 17, 2);
+	std::uint32_t record = 0;
+	for (char c : id.substr(20)) {
+		if (c < '0' || c > '9')
+			return false;
+		record = record * 10 + (c - '0');
+	}
+	key.record = record;
+	return true;
+}
+
+static bool entryLess(const IndexEntry& a, const IndexEntry& b) noexcept {
+	auto cmp = std::memcmp(a.segment, b.segment, sizeof(a.segment));
+	return cmp < 0 || (cmp == 0 && a.record < b.record);
+}
+
+/**
+ * @brief Input stream buffer that inflates a file starting at its current read position.
+ * @details Consecutive gzip members are decompressed as one stream. When started in raw mode (i.e., when resuming from
+ * a Checkpoint), the trailer of the current member is skipped before switching to the next member.
+ */
+class InflateBuf final : public std::streambuf {
+private:
+	std::istream& in;
+	z_stream strm{};
+	bool raw;
+	std::array<char, 1 << 16> inbuf;
+	std::array<char, 1 << 16> outbuf;
+
+	bool fill() {
+		in.read(inbuf.data(), inbuf.size());
+		strm.next_in = reinterpret_cast<Bytef*>(inbuf.data());
+		strm.avail_in = static_cast<uInt>(in.gcount());
+		return strm.avail_in > 0;
+	}
+
+	bool skipInput(std::size_t num) {
+		while (num > 0) {
+			if (strm.avail_in == 0 && !fill())
+				return false;
+			auto n = std::min<std::size_t>(num, strm.avail_in);
+			strm.next_in += n;
+			strm.avail_in -= n;
+			num -= n;
+		}
+		return true;
+	}
+
+protected:
+	int_type underflow() override {
+		while (true) {
+			if (strm.avail_in == 0 && !fill())
+				return traits_type::eof();
+			strm.next_out = reinterpret_cast<Bytef*>(outbuf.data());
+			strm.avail_out = outbuf.size();
+			auto ret = inflate(&strm, Z_NO_FLUSH);
+			if (ret == Z_STREAM_END) {
+				if (raw && !skipInput(8)) // CRC32 and ISIZE
+					return traits_type::eof();
+				raw = false;
+				inflateReset2(&strm, 15 + 16);
+			} else if (ret != Z_OK && ret != Z_BUF_ERROR) {
+				return traits_type::eof();
+			}
+			auto produced = outbuf.size() - strm.avail_out;
+			if (produced > 0) {
+				setg(outbuf.data(), outbuf.data(), outbuf.data() + produced);
+				return traits_type::to_int_type(outbuf[0]);
+			}
+		}
+	}
+
+public:
+	InflateBuf(std::istream& in, bool raw) : in(in), raw(raw) {
+		[[maybe_unused]] auto ret = inflateInit2(&strm, raw ? -15 : 15 + 16);
+		assert(ret == Z_OK);
+	}
+	~InflateBuf() { inflateEnd(&strm); }
+
+	void resume(const Checkpoint& checkpoint) {
+		assert(raw);
+		if (checkpoint.bits > 0) {
+			int byte = in.get();
+			inflatePrime(&strm, checkpoint.bits, byte >> (8 - checkpoint.bits));
+		}
+		inflateSetDictionary(&strm, checkpoint.window, checkpoint.windowLength);
+	}
+};
+
+WARCIndex::WARCIndex(int fd, const char* data, std::size_t size) noexcept : fd(fd), data(data), size(size) {}
+WARCIndex::~WARCIndex() {
+	munmap(const_cast<char*>(data), size);
+	::close(fd);
+}
+
+std::unique_ptr<WARCIndex> WARCIndex::open(const fs::path& path) {
+	std::error_code ec;
+	auto size = fs::file_size(path, ec);
+	if (ec || size < sizeof(IndexHeader))
+		return nullptr;
+	int fd = ::open(path.c_str(), O_RDONLY);
+	if (fd < 0)
+		return nullptr;
+	auto mapped = mmap(nullptr, size, PROT_READ, MAP_SHARED, fd, 0);
+	if (mapped == MAP_FAILED) {
+		::close(fd);
+		return nullptr;
+	}
+	std::unique_ptr<WARCIndex> index(new WARCIndex(fd, reinterpret_cast<const char*>(mapped), size));
+	// The entries and checkpoints must lie within the file; the counts are divided rather than multiplied such that
+	// huge counts cannot overflow
+	const auto& header = index->header();
+	if (header.magic != indexMagic || header.numEntries > (size - sizeof(IndexHeader)) / sizeof(IndexEntry) ||
+		header.checkpointOffset > size || header.numCheckpoints > (size - header.checkpointOffset) / sizeof(Checkpoint))
+		return nullptr;
+	return index;
+}
+
+std::span<const IndexEntry> WARCIndex::entries() const noexcept {
+	return {reinterpret_cast<const IndexEntry*>(data + sizeof(IndexHeader)), header().numEntries};
+}
+
+const Checkpoint& WARCIndex::checkpoint(std::uint32_t idx) const noexcept {
+	return reinterpret_cast<const Checkpoint*>(data + header().checkpointOffset)[idx];
+}
+
+const IndexEntry* WARCIndex::find(std::string_view trecId) const noexcept {
+	IndexEntry key{};
+	if (!parseTrecId(trecId, key))
+		return nullptr;
+	auto all = entries();
+	auto it = std::lower_bound(all.begin(), all.end(), key, entryLess);
+	return (it != all.end() && !entryLess(key, *it)) ? &*it : nullptr;
+}
+
+bool WARCIndex::readRecord(const IndexEntry& entry, const fs::path& segmentFile, WARCRecord& record) const {
+	std::ifstream file(segmentFile, std::ios::binary);
+	if (!file.good())
+		return false;
+	const bool fromCheckpoint = entry.checkpoint != noCheckpoint;
+	if (fromCheckpoint) {
+		// Entries are only checked when read such that opening the index takes the same time regardless of its size
+		if (entry.checkpoint >= header().numCheckpoints)
+			return false;
+		const auto& cp = checkpoint(entry.checkpoint);
+		if (cp.bits > 7 || cp.windowLength > windowSize)
+			return false;
+		file.seekg(cp.in - (cp.bits > 0 ? 1 : 0));
+	} else {
+		file.seekg(entry.offset);
+	}
+	InflateBuf buf(file, fromCheckpoint);
+	if (fromCheckpoint)
+		buf.resume(checkpoint(entry.checkpoint));
+	std::istream stream(&buf);
+	stream.ignore(entry.skip);
+	return static_cast<bool>(stream >> record);
+}
+
+/**
+ * @brief Incrementally finds the records (their decompressed offset and TREC-ID) within the decompressed stream.
+ */
+class RecordScanner final {
+private:
+	std::string pending;
+	std::uint64_t pendingStart = 0; ///< Decompressed offset of pending[0]
+	std::uint64_t skipUntil = 0;	///< Decompressed offset where the next record may start
+
+public:
+	struct Found {
+		std::uint64_t offset;
+		std::string trecId;
+	};
+
+	template <typename F>
+	void feed(const char* data, std::size_t len, F onRecord) {
+		pending.append(data, len);
+		while (true) {
+			if (skipUntil > pendingStart) {
+				auto drop = std::min<std::uint64_t>(skipUntil - pendingStart, pending.size());
+				pending.erase(0, drop);
+				pendingStart += drop;
+				if (skipUntil > pendingStart)
+					return;
+			}
+			auto begin = pending.find_first_not_of(" \t\r\n");
+			if (begin == std::string::npos) {
+				pendingStart += pending.size();
+				pending.clear();
+				return;
+			}
+			auto headerEnd = pending.find("\r\n\r\n", begin);
+			if (headerEnd == std::string::npos)
+				return;
+			std::istringstream header(pending.substr(begin, headerEnd - begin));
+			std::string line, trecId;
+			std::uint64_t contentLength = 0;
+			std::getline(header, line);
+			while (std::getline(header, line)) {
+				if (line.find(':') == std::string::npos)
+					continue;
+				auto [key, value] = split(line, ':');
+				if (key == "WARC-TREC-ID")
+					trecId = value;
+				else if (key == "Content-Length")
+					contentLength = std::strtoull(value.c_str(), nullptr, 10);
+			}
+			if (!trecId.empty())
+				onRecord(Found{.offset = pendingStart + begin, .trecId = std::move(trecId)});
+			skipUntil = pendingStart + headerEnd + 4 + contentLength;
+		}
+	}
+};
+
+/**
+ * @brief Decompresses the file once and appends the location of each of its records.
+ * @details Checkpoints are created at deflate block boundaries whenever a gzip member grew by `span` bytes since the
+ * last member start or checkpoint. Only those that end up being the closest anchor of some record are kept.
+ */
+static void scanFile(
+		const fs::path& path, std::size_t span, std::vector<IndexEntry>& entries, std::vector<Checkpoint>& checkpoints
+) {
+	std::ifstream file(path, std::ios::binary);
+	assert(file);
+	z_stream strm{};
+	[[maybe_unused]] auto ret = inflateInit2(&strm, 15 + 16);
+	assert(ret == Z_OK);
+
+	struct Anchor {
+		std::uint64_t out;
+		std::uint64_t in;
+		std::uint32_t checkpoint;
+	};
+	std::vector<Anchor> anchors = {{.out = 0, .in = 0, .checkpoint = noCheckpoint}}; // The first member
+	std::vector<Checkpoint> candidates;
+	std::vector<RecordScanner::Found> records;
+	RecordScanner scanner;
+	std::array<char, 1 << 16> inbuf;
+	std::array<char, 1 << 16> outbuf;
+	std::uint64_t totalIn = 0, totalOut = 0;
+	bool memberEnded = false;
+	while (true) {
+		if (strm.avail_in == 0) {
+			file.read(inbuf.data(), inbuf.size());
+			if (file.gcount() == 0)
+				break;
+			strm.next_in = reinterpret_cast<Bytef*>(inbuf.data());
+			strm.avail_in = static_cast<uInt>(file.gcount());
+		}
+		if (memberEnded) {
+			// Another gzip member starts here
+			inflateReset(&strm);
+			anchors.push_back({.out = totalOut, .in = totalIn, .checkpoint = noCheckpoint});
+			memberEnded = false;
+		}
+		strm.next_out = reinterpret_cast<Bytef*>(outbuf.data());
+		strm.avail_out = outbuf.size();
+		auto availIn = strm.avail_in;
+		// Z_BLOCK returns at every deflate block boundary such that we can place checkpoints there
+		ret = inflate(&strm, Z_BLOCK);
+		totalIn += availIn - strm.avail_in;
+		auto produced = outbuf.size() - strm.avail_out;
+		scanner.feed(outbuf.data(), produced, [&records](auto&& found) { records.emplace_back(std::move(found)); });
+		totalOut += produced;
+		if (ret == Z_STREAM_END) {
+			memberEnded = true;
+		} else if (ret != Z_OK && ret != Z_BUF_ERROR) {
+			std::cerr << "Failed to inflate " << path << ": " << (strm.msg ? strm.msg : "") << std::endl;
+			break;
+		} else if ((strm.data_type & 128) && !(strm.data_type & 64) && totalOut - anchors.back().out >= span) {
+			auto& cp = candidates.emplace_back();
+			cp.in = totalIn;
+			cp.out = totalOut;
+			cp.bits = strm.data_type & 7;
+			uInt windowLength = windowSize;
+			inflateGetDictionary(&strm, cp.window, &windowLength);
+			cp.windowLength = windowLength;
+			anchors.push_back({.out = totalOut, .in = totalIn, .checkpoint = (std::uint32_t)(candidates.size() - 1)});
+		}
+	}
+	inflateEnd(&strm);
+
+	std::vector<std::uint32_t> remap(candidates.size(), noCheckpoint);
+	for (auto&& found : records) {
+		IndexEntry entry{};
+		if (!parseTrecId(found.trecId, entry))
+			continue;
+		auto anchor = std::prev(std::upper_bound(anchors.begin(), anchors.end(), found.offset, [](auto off, auto& a) {
+			return off < a.out;
+		}));
+		entry.checkpoint = anchor->checkpoint;
+		if (entry.checkpoint != noCheckpoint) {
+			if (remap[entry.checkpoint] == noCheckpoint) {
+				remap[entry.checkpoint] = checkpoints.size();
+				checkpoints.emplace_back(candidates[entry.checkpoint]);
+			}
+			entry.checkpoint = remap[entry.checkpoint];
+		}
+		entry.offset = anchor->in;
+		entry.skip = found.offset - anchor->out;
+		entries.push_back(entry);
+	}
+}
+
+void warc::v1::buildIndex(const fs::path& base, const fs::path& out, std::size_t span) {
+	std::vector<fs::path> files;
+	for (auto const& dirEntry : fs::recursive_directory_iterator(base))
+		if (dirEntry.is_regular_file() && dirEntry.path().string().ends_with(".warc.gz"))
+			files.emplace_back(dirEntry.path());
+	std::sort(files.begin(), files.end());
+
+	std::vector<IndexEntry> entries;
+	std::vector<Checkpoint> checkpoints;
+	for (size_t i = 0; i < files.size(); ++i) {
+		scanFile(files[i], span, entries, checkpoints);
+		std::cout << "\r" << (i + 1) << "/" << files.size() << " files, " << entries.size() << " records" << std::flush;
+	}
+	std::cout << std::endl;
+	std::sort(entries.begin(), entries.end(), entryLess);
+
+	std::ofstream file(out, std::ios::binary | std::ios::trunc);
+	assert(file);
+	IndexHeader header{
+			.magic = indexMagic,
+			.numEntries = entries.size(),
+			.numCheckpoints = checkpoints.size(),
+			.checkpointOffset = sizeof(IndexHeader) + entries.size() * sizeof(IndexEntry)
+	};
+	file.write(reinterpret_cast<const char*>(&header), sizeof(header));
+	file.write(reinterpret_cast<const char*>(entries.data()), entries.size() * sizeof(IndexEntry));
+	file.write(reinterpret_cast<const char*>(checkpoints.data()), checkpoints.size() * sizeof(Checkpoint));
+}
+static int hexValue(char c) noexcept {
+	if (c >= '0' && c <= '9')
+		return c - '0';
+	if (c >= 'a' && c <= 'f')
+		return c - 'a' + 10;
+	if (c >= 'A' && c <= 'F')
+		return c - 'A' + 10;
+	return -1;
+}
+
+bool warc::v1::parseRecordId(std::string_view id, std::uint8_t (&uuid)[16]) noexcept {
+	// <urn:uuid:f8b0a0f3-5a4c-4f3e-9d1c-0123456789ab>
+	static constexpr std::string_view prefix = "urn:uuid:";
+	if (id.starts_with('<') && id.ends_with('>'))
+		id = id.substr(1, id.size() - 2);
+	if (id.size() != prefix.size() + 36 || !id.starts_with(prefix))
+		return false;
+	id.remove_prefix(prefix.size());
+	size_t n = 0;
+	for (size_t i = 0; i < id.size(); i += 2) {
+		if (i == 8 || i == 13 || i == 18 || i == 23) {
+			if (id[i] != '-')
+				return false;
+			--i; // The groups have an even number of digits such that a byte never spans a dash
+			continue;
+		}
+		auto hi = hexValue(id[i]), lo = hexValue(id[i + 1]);
+		if (hi < 0 || lo < 0)
+			return false;
+		uuid[n++] = static_cast<std::uint8_t>(hi << 4 | lo);
+	}
+	return n == 16;
+}
+
+static bool recordLess(const RecordMapEntry& a, const RecordMapEntry& b) noexcept {
+	return std::memcmp(a.uuid, b.uuid, sizeof(a.uuid)) < 0;
+}
+
+/** @returns the first 8 bytes of the UUID as a big-endian number such that it is ordered like the UUIDs **/
+static std::uint64_t uuidPrefix(const RecordMapEntry& entry) noexcept {
+	std::uint64_t prefix = 0;
+	for (size_t i = 0; i < 8; ++i)
+		prefix = prefix << 8 | entry.uuid[i];
+	return prefix;
+}
+
+RecordMap::RecordMap(int fd, const char* data, std::size_t size) noexcept : fd(fd), data(data), size(size) {}
+RecordMap::~RecordMap() {
+	munmap(const_cast<char*>(data), size);
+	::close(fd);
+}
+
+std::unique_ptr<RecordMap> RecordMap::open(const fs::path& path) {
+	std::error_code ec;
+	auto size = fs::file_size(path, ec);
+	if (ec || size < sizeof(RecordMapHeader))
+		return nullptr;
+	int fd = ::open(path.c_str(), O_RDONLY);
+	if (fd < 0)
+		return nullptr;
+	auto mapped = mmap(nullptr, size, PROT_READ, MAP_SHARED, fd, 0);
+	if (mapped == MAP_FAILED) {
+		::close(fd);
+		return nullptr;
+	}
+	std::unique_ptr<RecordMap> map(new RecordMap(fd, reinterpret_cast<const char*>(mapped), size));
+	const auto& header = *reinterpret_cast<const RecordMapHeader*>(map->data);
+	if (header.magic != recordMapMagic || size != sizeof(RecordMapHeader) + header.numEntries * sizeof(RecordMapEntry))
+		return nullptr;
+	return map;
+}
+
+std::span<const RecordMapEntry> RecordMap::entries() const noexcept {
+	return {reinterpret_cast<const RecordMapEntry*>(data + sizeof(RecordMapHeader)),
+			reinterpret_cast<const RecordMapHeader*>(data)->numEntries};
+}
+
+std::string RecordMap::find(std::string_view recordId) const {
+	RecordMapEntry key{};
+	if (!parseRecordId(recordId, key.uuid))
+		return {};
+	auto all = entries();
+	const RecordMapEntry* found = nullptr;
+	// Interpolate on the leading 8 bytes for a few probes and finish the remaining range with a binary search in case
+	// the UUIDs are not as uniform as expected
+	size_t lo = 0, hi = all.size();
+	const auto target = uuidPrefix(key);
+	for (unsigned probes = 0; found == nullptr && hi - lo > 16 && probes < 8; ++probes) {
+		const auto first = uuidPrefix(all[lo]), last = uuidPrefix(all[hi - 1]);
+		if (target <= first || target >= last)
+			break;
+		auto pos = lo + static_cast<size_t>((unsigned __int128)(target - first) * (hi - 1 - lo) / (last - first));
+		if (recordLess(all[pos], key))
+			lo = pos + 1;
+		else if (recordLess(key, all[pos]))
+			hi = pos;
+		else
+			found = &all[pos];
+	}
+	if (found == nullptr) {
+		auto it = std::lower_bound(all.begin() + lo, all.begin() + hi, key, recordLess);
+		if (it == all.begin() + hi || recordLess(key, *it))
+			return {};
+		found = &*it;
+	}
+	// clueweb12-0000tw-00-00042
+	std::string trecId = "clueweb12-";
+	trecId.append(found->segment, 6).append("-").append(found->segment + 6, 2).append("-");
+	auto record = std::to_string(found->record);
+	trecId.append(record.size() < 5 ? 5 - record.size() : 0, '0').append(record);
+	return trecId;
+}
+
+std::size_t warc::v1::buildRecordMap(const fs::path& in, const fs::path& out) {
+	std::ifstream file(in);
+	if (!file)
+		throw std::runtime_error(std::format("Cannot open {}", in.string()));
+	std::vector<RecordMapEntry> entries;
+	std::size_t skipped = 0;
+	for (std::string line; std::getline(file, line);) {
+		RecordMapEntry entry{};
+		IndexEntry trecId{};
+		auto tab = line.find('\t');
+		if (tab == std::string::npos || !parseRecordId(std::string_view(line).substr(0, tab), entry.uuid) ||
+			!parseTrecId(std::string_view(line).substr(tab + 1), trecId)) {
+			++skipped;
+			continue;
+		}
+		std::memcpy(entry.segment, trecId.segment, sizeof(entry.segment));
+		entry.record = trecId.record;
+		entries.push_back(entry);
+	}
+	if (file.bad())
+		throw std::runtime_error(std::format("Cannot read {}", in.string()));
+	// Should a record id appear twice, the last line wins (as it did when the text file was read into a map)
+	std::stable_sort(entries.begin(), entries.end(), recordLess);
+	size_t numUnique = 0;
+	for (size_t i = 0; i < entries.size(); ++i)
+		if (i + 1 == entries.size() || recordLess(entries[i], entries[i + 1]))
+			entries[numUnique++] = entries[i];
+	entries.resize(numUnique);
+
+	// Written next to `out` and renamed such that a failed write never leaves a map that opens but lacks entries
+	auto tmp = out;
+	tmp += ".tmp";
+	{
+		std::ofstream outFile(tmp, std::ios::binary | std::ios::trunc);
+		RecordMapHeader header{.magic = recordMapMagic, .numEntries = entries.size()};
+		outFile.write(reinterpret_cast<const char*>(&header), sizeof(header));
+		outFile.write(reinterpret_cast<const char*>(entries.data()), entries.size() * sizeof(RecordMapEntry));
+		outFile.close();
+		if (!outFile) {
+			std::error_code ec;
+			fs::remove(tmp, ec);
+			throw std::runtime_error(std::format("Cannot write {}", tmp.string()));
+		}
+	}
+	fs::rename(tmp, out);
+	return skipped;
+}